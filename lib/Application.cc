@@ -26,6 +26,7 @@
 #include "Application.hh"
 #include "Display.hh"
 #include "EventHandler.hh"
+#include "EventProfiler.hh"
 #include "Menu.hh"
 
 #include <X11/Xlib.h>
@@ -43,6 +44,12 @@
 #endif
 #include <sys/time.h>
 #include <sys/wait.h>
+#ifdef    EPOLL
+#  include <sys/epoll.h>
+#  include <sys/signalfd.h>
+#  include <sys/timerfd.h>
+#  include <stdint.h>
+#endif // EPOLL
 #include <assert.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -51,6 +58,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <typeinfo>
 
 #if defined(__GNUC__)
 #  if __GNUC__ == 3 && __GNUC_MINOR__ == 3
@@ -64,6 +72,13 @@ static void *workaround __attribute__((__unused__)) = 0;
 static bt::Application *base_app = 0;
 static sig_atomic_t pending_signals = 0;
 
+// non-fatal signals
+static const int handled_signals[] = {
+  SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGPIPE, SIGCHLD, SIGUSR1, SIGUSR2
+};
+static const unsigned int handled_signal_count =
+  sizeof(handled_signals) / sizeof(handled_signals[0]);
+
 
 static int handleXErrors(Display *d, XErrorEvent *e) {
 #ifdef    DEBUG
@@ -90,10 +105,33 @@ static void signalhandler(int sig)
 { pending_signals |= (1 << sig); }
 
 
+#ifdef    EPOLL
+static sigset_t handledSignalSet(void) {
+  sigset_t set;
+  sigemptyset(&set);
+  for (unsigned int i = 0; i < handled_signal_count; ++i)
+    sigaddset(&set, handled_signals[i]);
+  return set;
+}
+
+
+static bool epollControl(int epfd, int op, int fd, unsigned int events) {
+  epoll_event event;
+  event.events = (((events & bt::FileHandler::Readable) ? EPOLLIN : 0u)
+                  | ((events & bt::FileHandler::Writable) ? EPOLLOUT : 0u));
+  event.data.u64 = 0;
+  event.data.fd = fd;
+  return epoll_ctl(epfd, op, fd, &event) == 0;
+}
+#endif // EPOLL
+
+
 bt::Application::Application(const std::string &app_name, const char *dpy_name,
                              bool multi_head)
   : _app_name(bt::basename(app_name)), run_state(STARTUP),
-    xserver_time(CurrentTime), menu_grab(false)
+    xserver_time(CurrentTime), wakeup_count(0ul), timer_wakeup_count(0ul),
+    event_fd(-1), timer_fd(-1), signal_fd(-1), profiler(0),
+    menu_grab(false)
 {
   assert(base_app == 0);
   ::base_app = this;
@@ -105,15 +143,39 @@ bt::Application::Application(const std::string &app_name, const char *dpy_name,
   action.sa_mask = sigset_t();
   action.sa_flags = SA_NOCLDSTOP;
 
-  // non-fatal signals
-  sigaction(SIGHUP,  &action, NULL);
-  sigaction(SIGINT,  &action, NULL);
-  sigaction(SIGQUIT, &action, NULL);
-  sigaction(SIGTERM, &action, NULL);
-  sigaction(SIGPIPE, &action, NULL);
-  sigaction(SIGCHLD, &action, NULL);
-  sigaction(SIGUSR1, &action, NULL);
-  sigaction(SIGUSR2, &action, NULL);
+  for (unsigned int i = 0; i < handled_signal_count; ++i)
+    sigaction(handled_signals[i], &action, NULL);
+
+#ifdef    EPOLL
+  /*
+    Wait for the X connection, timers, signals and file handlers with
+    a single epoll_wait(2).  The signals are blocked and read from a
+    signalfd; the handlers above stay installed for SA_NOCLDSTOP.  If
+    any of this fails, the event loop falls back to select(2).
+  */
+  const sigset_t signals = handledSignalSet();
+  event_fd = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (event_fd == -1 || timer_fd == -1 || signal_fd == -1
+      || !epollControl(event_fd, EPOLL_CTL_ADD,
+                       XConnectionNumber(_display->XDisplay()),
+                       FileHandler::Readable)
+      || !epollControl(event_fd, EPOLL_CTL_ADD, timer_fd,
+                       FileHandler::Readable)
+      || !epollControl(event_fd, EPOLL_CTL_ADD, signal_fd,
+                       FileHandler::Readable)) {
+    if (event_fd != -1)
+      close(event_fd);
+    if (timer_fd != -1)
+      close(timer_fd);
+    if (signal_fd != -1)
+      close(signal_fd);
+    event_fd = timer_fd = signal_fd = -1;
+  } else {
+    sigprocmask(SIG_BLOCK, &signals, NULL);
+  }
+#endif // EPOLL
 
   kbd.major = 1;
   kbd.minor = 0;
@@ -179,14 +241,22 @@ bt::Application::Application(const std::string &app_name, const char *dpy_name,
     XFreeModifiermap(const_cast<XModifierKeymap*>(modmap));
 
   XrmInitialize();
-
-  ::timeval tv;
-  gettimeofday(&tv, 0);
-  currentTime = tv;
 }
 
 
 bt::Application::~Application(void) {
+#ifdef    EPOLL
+  if (event_fd != -1) {
+    const sigset_t signals = handledSignalSet();
+    sigprocmask(SIG_UNBLOCK, &signals, NULL);
+
+    close(signal_fd);
+    close(timer_fd);
+    close(event_fd);
+  }
+#endif // EPOLL
+
+  delete profiler;
   delete _display;
   ::base_app = 0;
 }
@@ -200,8 +270,15 @@ void bt::Application::startup(void)
 { }
 
 
-void bt::Application::shutdown(void)
-{ }
+void bt::Application::shutdown(void) {
+#ifdef    EPOLL
+  // programs exec'd on restart inherit the signal mask
+  if (event_fd != -1) {
+    const sigset_t signals = handledSignalSet();
+    sigprocmask(SIG_UNBLOCK, &signals, NULL);
+  }
+#endif // EPOLL
+}
 
 
 void bt::Application::run(void) {
@@ -209,8 +286,6 @@ void bt::Application::run(void) {
 
   setRunState(RUNNING);
 
-  const int xfd = XConnectionNumber(_display->XDisplay());
-
   while (run_state == RUNNING) {
     if (pending_signals) {
       // handle any pending signals
@@ -239,10 +314,15 @@ void bt::Application::run(void) {
 
     do {
       XEvent e;
+      int queued;
       while (run_state == RUNNING
-             && XEventsQueued(_display->XDisplay(), QueuedAlready)) {
+             && (queued = XEventsQueued(_display->XDisplay(),
+                                        QueuedAlready)) > 0) {
         XNextEvent(_display->XDisplay(), &e);
-        process_event(&e);
+        if (profiler)
+          profileEvent(&e, queued);
+        else
+          process_event(&e);
       }
     } while (run_state == RUNNING
              && XEventsQueued(_display->XDisplay(), QueuedAfterFlush));
@@ -250,37 +330,13 @@ void bt::Application::run(void) {
     if (run_state != RUNNING)
       break;
 
-    fd_set rfds;
-    ::timeval now, tm, *timeout = 0;
-
-    FD_ZERO(&rfds);
-    FD_SET(xfd, &rfds);
-
-    if (!timerList.empty()) {
-      const bt::Timer* const timer = timerList.top();
-
-      gettimeofday(&now, 0);
-      tm = timer->timeRemaining(now);
-
-      timeout = &tm;
-    }
-
-    int ret = select(xfd + 1, &rfds, 0, 0, timeout);
-    if (ret < 0) {
-      errno = 0;
-      continue; // perhaps a signal interrupted select(2)
-    }
+    waitForEvents();
+    ++wakeup_count;
 
     // check for timer timeout
-    gettimeofday(&now, 0);
-
-    {
-      // if the clock has rolled back, adjust all timers
-      timeval tv = now;
-      if (tv < currentTime)
-        adjustTimers(tv - currentTime);
-      currentTime = tv;
-    }
+    const Nanoseconds now = monotonicTime();
+    if (!timerList.empty() && timerList.top()->shouldFire(now))
+      ++timer_wakeup_count;
 
     /*
       there is a small chance for deadlock here:
@@ -307,6 +363,141 @@ void bt::Application::run(void) {
   shutdown();
 }
 
+/*
+ * Processes the event {event} while measuring how long it takes.
+ * {depth} is the number of events that were queued, including this
+ * one.
+ */
+void bt::Application::profileEvent(XEvent *event, unsigned int depth) {
+  // look at the event before process_event() modifies it
+  const int type = event->type;
+  const Window window = event->xany.window;
+  const EventHandler * const handler = findEventHandler(window);
+  const std::type_info * const handler_type =
+    handler ? &typeid(*handler) : 0;
+
+  const Nanoseconds start = monotonicTime();
+  process_event(event);
+  const Nanoseconds elapsed = monotonicTime() - start;
+
+  profiler->record(type, window, handler_type, depth,
+                   static_cast<long>(elapsed / 1000ll));
+}
+
+
+void bt::Application::setEventProfiling(bool enabled) {
+  if (enabled && !profiler) {
+    profiler = new EventProfiler(_app_name);
+  } else if (!enabled && profiler) {
+    delete profiler;
+    profiler = 0;
+  }
+}
+
+
+/*
+ * Waits for X events, file handlers, signals or the first timer,
+ * calling the file handlers that are ready.
+ */
+void bt::Application::waitForEvents(void) {
+  const int xfd = XConnectionNumber(_display->XDisplay());
+
+#ifdef    EPOLL
+  if (event_fd != -1) {
+    // the timerfd expires when the due timers can no longer wait
+    itimerspec spec;
+    spec.it_interval.tv_sec = spec.it_interval.tv_nsec = 0;
+    spec.it_value.tv_sec = spec.it_value.tv_nsec = 0;
+    if (!timerList.empty()) {
+      const Nanoseconds end = std::max(timerList.deadline(), 1ll);
+      spec.it_value.tv_sec = end / 1000000000ll;
+      spec.it_value.tv_nsec = end % 1000000000ll;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, 0);
+
+    epoll_event events[16];
+    const int count =
+      epoll_wait(event_fd, events, sizeof(events) / sizeof(events[0]), -1);
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == xfd)
+        continue;
+
+      if (fd == timer_fd) {
+        uint64_t expirations;
+        const ssize_t unused = read(timer_fd, &expirations,
+                                    sizeof(expirations));
+        (void) unused;
+      } else if (fd == signal_fd) {
+        signalfd_siginfo info;
+        while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+          pending_signals |= (1 << info.ssi_signo);
+      } else {
+        const uint32_t e = events[i].events;
+        unsigned int ready = 0u;
+        if (e & (EPOLLIN | EPOLLERR | EPOLLHUP))
+          ready |= FileHandler::Readable;
+        if (e & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+          ready |= FileHandler::Writable;
+
+        // an earlier handler may have removed this one
+        const FileHandlerMap::const_iterator it = filehandlers.find(fd);
+        if (it != filehandlers.end() && (ready & it->second.events))
+          it->second.handler->fileReady(fd, ready & it->second.events);
+      }
+    }
+    return;
+  }
+#endif // EPOLL
+
+  fd_set rfds, wfds;
+  ::timeval tm, *timeout = 0;
+  int maxfd = xfd;
+
+  FD_ZERO(&rfds);
+  FD_ZERO(&wfds);
+  FD_SET(xfd, &rfds);
+
+  FileHandlerMap::const_iterator it = filehandlers.begin();
+  for (; it != filehandlers.end(); ++it) {
+    if (it->second.events & FileHandler::Readable)
+      FD_SET(it->first, &rfds);
+    if (it->second.events & FileHandler::Writable)
+      FD_SET(it->first, &wfds);
+    maxfd = std::max(maxfd, it->first);
+  }
+
+  if (!timerList.empty()) {
+    const Nanoseconds remaining =
+      std::max(timerList.deadline() - monotonicTime(), 0ll);
+    tm.tv_sec = remaining / 1000000000ll;
+    tm.tv_usec = (remaining % 1000000000ll) / 1000ll;
+    timeout = &tm;
+  }
+
+  int ret = select(maxfd + 1, &rfds, &wfds, 0, timeout);
+  if (ret < 0) {
+    errno = 0;
+    return; // perhaps a signal interrupted select(2)
+  }
+
+  for (int fd = 0; ret > 0 && fd <= maxfd; ++fd) {
+    unsigned int ready = 0u;
+    if (FD_ISSET(fd, &rfds))
+      ready |= FileHandler::Readable;
+    if (FD_ISSET(fd, &wfds))
+      ready |= FileHandler::Writable;
+    if (!ready || fd == xfd)
+      continue;
+
+    // an earlier handler may have removed this one
+    it = filehandlers.find(fd);
+    if (it != filehandlers.end())
+      it->second.handler->fileReady(fd, ready);
+  }
+}
+
+
 void bt::Application::process_event(XEvent *event) {
   bt::EventHandler *handler = findEventHandler(event->xany.window);
   if (!handler)
@@ -590,7 +781,7 @@ bool bt::Application::process_signal(int signal) {
 
 void bt::Application::insertEventHandler(Window window,
                                          bt::EventHandler *handler) {
-  eventhandlers.insert(std::pair<Window,bt::EventHandler*>(window, handler));
+  eventhandlers.insert(window, handler);
 }
 
 
@@ -601,10 +792,8 @@ void bt::Application::removeEventHandler(Window window) {
 
 bt::EventHandler *bt::Application::findEventHandler(Window window)
 {
-  EventHandlerMap::iterator it = eventhandlers.find(window);
-  if (it == eventhandlers.end())
-    return 0;
-  return it->second;
+  EventHandler * const * const handler = eventhandlers.find(window);
+  return handler ? *handler : 0;
 }
 
 
@@ -643,21 +832,32 @@ void bt::Application::closeMenu(Menu *menu) {
 }
 
 
-void bt::Application::adjustTimers(const timeval &offset)
-{
-  // since we don't allow TimerQueues to be copied, we have to do it
-  // this way
-  TimerQueue tmp;
-  while (!timerList.empty()) {
-    Timer *t = timerList.top();
-    timerList.pop();
-    t->adjustStartTime(offset);
-    tmp.push(t);
-  }
-  assert(timerList.empty());
-  while (!tmp.empty()) {
-    Timer *t = tmp.top();
-    tmp.pop();
-    timerList.push(t);
+void bt::Application::insertFileHandler(int fd, unsigned int events,
+                                        FileHandler *handler) {
+  assert(fd >= 0 && handler != 0);
+  assert(fd != XConnectionNumber(_display->XDisplay()));
+
+#ifdef    EPOLL
+  if (event_fd != -1) {
+    const int op =
+      filehandlers.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (!epollControl(event_fd, op, fd, events))
+      perror("epoll_ctl");
   }
+#endif // EPOLL
+
+  FileRef &ref = filehandlers[fd];
+  ref.events = events;
+  ref.handler = handler;
+}
+
+
+void bt::Application::removeFileHandler(int fd) {
+  if (!filehandlers.erase(fd))
+    return;
+
+#ifdef    EPOLL
+  if (event_fd != -1)
+    epollControl(event_fd, EPOLL_CTL_DEL, fd, 0u);
+#endif // EPOLL
 }
@@ -27,6 +27,7 @@
 
 #include "Timer.hh"
 #include "Util.hh"
+#include "XIDTable.hh"
 
 #include <map>
 
@@ -35,8 +36,27 @@ namespace bt {
   // forward declarations
   class Display;
   class EventHandler;
+  class EventProfiler;
   class Menu;
 
+  /*
+    Receives notification when a file descriptor registered with
+    Application::insertFileHandler() is ready.
+  */
+  class FileHandler {
+  public:
+    enum Events { Readable = 1, Writable = 2 };
+
+    inline virtual ~FileHandler(void) { }
+
+    /*
+      Called from the event loop when {fd} is ready for some of the
+      {events} it was registered for.  Errors and hangups are reported
+      as all of the registered events.  This function must not block.
+    */
+    virtual void fileReady(int fd, unsigned int events) = 0;
+  };
+
   /*
     The application object.  It provides event delivery, timer
     activation and signal handling functionality to fit most
@@ -60,12 +80,25 @@ namespace bt {
     RunState run_state;
     Time xserver_time;
 
-    typedef std::map<Window,EventHandler*> EventHandlerMap;
+    typedef XIDTable<EventHandler*> EventHandlerMap;
     EventHandlerMap eventhandlers;
 
-    timeval currentTime;
     TimerQueue timerList;
-    void adjustTimers(const timeval &offset);
+    unsigned long wakeup_count, timer_wakeup_count;
+
+    struct FileRef {
+      unsigned int events;
+      FileHandler *handler;
+    };
+    typedef std::map<int,FileRef> FileHandlerMap;
+    FileHandlerMap filehandlers;
+
+    // the epoll(7) instance and its timerfd and signalfd, when used
+    int event_fd, timer_fd, signal_fd;
+    void waitForEvents(void);
+
+    EventProfiler *profiler;
+    void profileEvent(XEvent *event, unsigned int depth);
 
     typedef std::deque<Menu*> MenuStack;
     MenuStack menus;
@@ -153,6 +186,24 @@ namespace bt {
     inline unsigned int numLockMask(void) const
     { return NumLockMask; }
 
+    /*
+      Returns the number of times the event loop has woken up, and how
+      many of those wakeups fired at least one timer.
+    */
+    inline unsigned long wakeups(void) const
+    { return wakeup_count; }
+    inline unsigned long timerWakeups(void) const
+    { return timer_wakeup_count; }
+
+    /*
+      Enables or disables measuring the time spent in process_event().
+      Disabling the profiler discards its results.
+    */
+    void setEventProfiling(bool enabled);
+    // returns the event profiler, or zero if profiling is disabled
+    inline EventProfiler *eventProfiler(void) const
+    { return profiler; }
+
     // from TimerQueueManager interface
     virtual void addTimer(Timer *timer);
     virtual void removeTimer(Timer *timer);
@@ -171,6 +222,20 @@ namespace bt {
       handler has been registered, this function returns zero.
     */
     EventHandler *findEventHandler(Window window);
+
+    /*
+      Calls {handler} whenever file descriptor {fd} is ready for any of
+      {events}, a combination of FileHandler::Readable and
+      FileHandler::Writable.  Replaces the handler previously inserted
+      for {fd}, if any.
+    */
+    void insertFileHandler(int fd, unsigned int events,
+                           FileHandler *handler);
+    /*
+      Removes the FileHandler for {fd}.  This must be done before {fd}
+      is closed.
+    */
+    void removeFileHandler(int fd);
   };
 
 } // namespace bt
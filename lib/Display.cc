@@ -58,10 +58,18 @@ namespace bt {
   void destroyColorTables(void);
 
 
+  void stopWorkerThreads(void);
+
+
 #ifdef    MITSHM
   void startupShm(const Display &display);
+  void shutdownShm(const Display &display);
 #endif // MITSHM
 
+#ifdef    XRENDER
+  void startupRender(const Display &display);
+#endif // XRENDER
+
 } // namespace bt
 
 
@@ -100,10 +108,19 @@ bt::Display::Display(const char *dpy_name, bool multi_head) {
 #ifdef    MITSHM
   startupShm(*this);
 #endif // MITSHM
+
+#ifdef    XRENDER
+  startupRender(*this);
+#endif // XRENDER
 }
 
 
 bt::Display::~Display() {
+#ifdef    MITSHM
+  shutdownShm(*this);
+#endif // MITSHM
+
+  stopWorkerThreads();
   destroyColorTables();
   destroyPixmapCache();
   destroyPenLoader();
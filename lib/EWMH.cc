@@ -23,6 +23,7 @@
 // DEALINGS IN THE SOFTWARE.
 
 #include "EWMH.hh"
+#include "PropertyBatch.hh"
 
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
@@ -558,10 +559,9 @@ bool bt::EWMH::readWMStrut(Window target, Strut* strut) const {
   unsigned long nitems, bytes_left;
   unsigned char *data;
 
-  int ret = XGetWindowProperty(display.XDisplay(), target, net_wm_strut,
-                               0l, 4l, false,
-                               XA_CARDINAL, &atom_return, &size,
-                               &nitems, &bytes_left, &data);
+  int ret = getWindowProperty(display.XDisplay(), target, net_wm_strut,
+                              0l, 4l, XA_CARDINAL, &atom_return, &size,
+                              &nitems, &bytes_left, &data);
   if (ret != Success || nitems < 4)
     return false;
 
@@ -584,10 +584,9 @@ bool bt::EWMH::readWMStrutPartial(Window target, StrutPartial* strut) const {
   unsigned long nitems, bytes_left;
   unsigned char *data;
 
-  int ret = XGetWindowProperty(display.XDisplay(), target, net_wm_strut_partial,
-                               0l, 12l, false,
-                               XA_CARDINAL, &atom_return, &size,
-                               &nitems, &bytes_left, &data);
+  int ret = getWindowProperty(display.XDisplay(), target, net_wm_strut_partial,
+                              0l, 12l, XA_CARDINAL, &atom_return, &size,
+                              &nitems, &bytes_left, &data);
   if (ret != Success || nitems < 12)
     return false;
 
@@ -726,10 +725,9 @@ bool bt::EWMH::getProperty(Window target, Atom type, Atom property,
   int size;
   unsigned long nitems, bytes_left;
 
-  int ret = XGetWindowProperty(display.XDisplay(), target, property,
-                               0l, 1l, false,
-                               type, &atom_return, &size,
-                               &nitems, &bytes_left, data);
+  int ret = getWindowProperty(display.XDisplay(), target, property,
+                              0l, 1l, type, &atom_return, &size,
+                              &nitems, &bytes_left, data);
   if (ret != Success || nitems != 1)
     return false;
 
@@ -744,20 +742,18 @@ bool bt::EWMH::getListProperty(Window target, Atom type, Atom property,
   int size;
   unsigned long nitems, bytes_left;
 
-  int ret = XGetWindowProperty(display.XDisplay(), target, property,
-                               0l, 1l, false,
-                               type, &atom_return, &size,
-                               &nitems, &bytes_left, data);
+  int ret = getWindowProperty(display.XDisplay(), target, property,
+                              0l, 1l, type, &atom_return, &size,
+                              &nitems, &bytes_left, data);
   if (ret != Success || nitems < 1)
     return false;
 
   if (bytes_left != 0) {
     XFree(*data);
     unsigned long remain = ((size / 8) * nitems) + bytes_left;
-    ret = XGetWindowProperty(display.XDisplay(), target,
-                             property, 0l, remain, false,
-                             type, &atom_return, &size,
-                             &nitems, &bytes_left, data);
+    ret = getWindowProperty(display.XDisplay(), target,
+                            property, 0l, remain, type, &atom_return, &size,
+                            &nitems, &bytes_left, data);
     if (ret != Success)
       return false;
   }
@@ -0,0 +1,214 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// EventProfiler.cc for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#include "gettext.h"
+#include "EventProfiler.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef    __GNUG__
+#  include <cxxabi.h>
+#endif // __GNUG__
+
+
+namespace bt {
+
+  // returns the readable name of a handler class
+  static std::string className(const char *name) {
+    if (!name)
+      return "(none)";
+    std::string ret = name;
+#ifdef    __GNUG__
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(name, 0, 0, &status);
+    if (demangled) {
+      if (status == 0)
+        ret = demangled;
+      free(demangled);
+    }
+#endif // __GNUG__
+    return ret;
+  }
+
+
+  static void printHistogram(FILE *file, const char *name,
+                             const unsigned long *counts) {
+    fprintf(file, "%-24s", name);
+    for (unsigned int t = 0; t < EventProfiler::TimeCount; ++t)
+      fprintf(file, " %7lu", counts[t]);
+    fprintf(file, "\n");
+  }
+
+} // namespace bt
+
+
+bt::EventProfiler::EventProfiler(const std::string &app_name)
+  : _app_name(app_name), stall_threshold(0l)
+{ reset(); }
+
+
+void bt::EventProfiler::record(int type, Window window,
+                               const std::type_info *handler,
+                               unsigned int depth, long usecs) {
+  unsigned int time = 0;
+  while (time < TimeCount - 1 && usecs >= (16l << time))
+    ++time;
+
+  ++events;
+  ++by_type[(type >= 0 && type < LASTEvent) ? type : LASTEvent][time];
+
+  const char * const name = handler ? handler->name() : 0;
+  HandlerMap::iterator it = by_handler.find(name);
+  if (it == by_handler.end()) {
+    Histogram empty;
+    memset(&empty, 0, sizeof(empty));
+    it = by_handler.insert(HandlerMap::value_type(name, empty)).first;
+  }
+  ++it->second.counts[time];
+
+  unsigned int d = 0;
+  while (d < DepthCount - 1 && depth >= (1u << d))
+    ++d;
+  ++by_depth[d];
+
+  // replace the fastest of the slowest events once the list is full
+  unsigned int slot = slowest_count;
+  if (slowest_count < SlowestCount) {
+    ++slowest_count;
+  } else {
+    slot = 0;
+    for (unsigned int i = 1; i < SlowestCount; ++i) {
+      if (slowest[i].usecs < slowest[slot].usecs)
+        slot = i;
+    }
+    if (usecs <= slowest[slot].usecs)
+      slot = SlowestCount;
+  }
+  if (slot < SlowestCount) {
+    slowest[slot].type = type;
+    slowest[slot].window = window;
+    slowest[slot].handler = name;
+    slowest[slot].usecs = usecs;
+  }
+
+  if (stall_threshold > 0l && usecs >= stall_threshold * 1000l) {
+    fprintf(stderr,
+            gettext("%s: stall: %s for window 0x%lx took %ld ms in %s\n"),
+            _app_name.c_str(), typeName(type), window, usecs / 1000l,
+            className(name).c_str());
+  }
+}
+
+
+void bt::EventProfiler::reset(void) {
+  events = 0ul;
+  memset(by_type, 0, sizeof(by_type));
+  by_handler.clear();
+  memset(by_depth, 0, sizeof(by_depth));
+  memset(slowest, 0, sizeof(slowest));
+  slowest_count = 0u;
+}
+
+
+bool bt::EventProfiler::dump(const std::string &filename,
+                             unsigned long wakeups,
+                             unsigned long timer_wakeups) const {
+  FILE *file = fopen(filename.c_str(), "w");
+  if (!file)
+    return false;
+
+  fprintf(file,
+          "events: %lu\n"
+          "wakeups: %lu (%lu fired timers)\n"
+          "stall threshold: %ld ms\n",
+          events, wakeups, timer_wakeups, stall_threshold);
+
+  // one line per event type and handler class, with the dispatch time
+  // buckets as columns
+  fprintf(file, "events by dispatch time (microseconds):\n%-24s", "type");
+  for (unsigned int t = 0; t < TimeCount - 1; ++t)
+    fprintf(file, " %7lu", 16ul << t);
+  fprintf(file, "    more\n");
+  for (int type = 0; type < TypeCount; ++type) {
+    bool any = false;
+    for (unsigned int t = 0; t < TimeCount; ++t)
+      any = any || by_type[type][t] != 0;
+    if (any)
+      printHistogram(file, typeName(type), by_type[type]);
+  }
+
+  fprintf(file, "handlers by dispatch time (microseconds):\n");
+  HandlerMap::const_iterator it = by_handler.begin();
+  for (; it != by_handler.end(); ++it)
+    printHistogram(file, className(it->first).c_str(), it->second.counts);
+
+  fprintf(file, "queue depth when dequeued:\n");
+  for (unsigned int d = 0; d < DepthCount; ++d) {
+    if (d < DepthCount - 1)
+      fprintf(file, "<%-6u %lu\n", 1u << d, by_depth[d]);
+    else
+      fprintf(file, "%-7s %lu\n", "more", by_depth[d]);
+  }
+
+  // the slowest events, slowest first
+  fprintf(file, "slowest events:\n");
+  bool printed[SlowestCount];
+  memset(printed, 0, sizeof(printed));
+  for (unsigned int n = 0; n < slowest_count; ++n) {
+    unsigned int next = SlowestCount;
+    for (unsigned int i = 0; i < slowest_count; ++i) {
+      if (!printed[i]
+          && (next == SlowestCount || slowest[i].usecs > slowest[next].usecs))
+        next = i;
+    }
+    printed[next] = true;
+    fprintf(file, "%9ld us  %-18s 0x%08lx  %s\n",
+            slowest[next].usecs, typeName(slowest[next].type),
+            slowest[next].window, className(slowest[next].handler).c_str());
+  }
+
+  return (fclose(file) == 0);
+}
+
+
+const char *bt::EventProfiler::typeName(int type) {
+  static const char * const names[] = {
+    "(error)", "(reply)", "KeyPress", "KeyRelease", "ButtonPress",
+    "ButtonRelease", "MotionNotify", "EnterNotify", "LeaveNotify",
+    "FocusIn", "FocusOut", "KeymapNotify", "Expose", "GraphicsExpose",
+    "NoExpose", "VisibilityNotify", "CreateNotify", "DestroyNotify",
+    "UnmapNotify", "MapNotify", "MapRequest", "ReparentNotify",
+    "ConfigureNotify", "ConfigureRequest", "GravityNotify",
+    "ResizeRequest", "CirculateNotify", "CirculateRequest",
+    "PropertyNotify", "SelectionClear", "SelectionRequest",
+    "SelectionNotify", "ColormapNotify", "ClientMessage", "MappingNotify",
+    "GenericEvent"
+  };
+  if (type >= 0 && type < LASTEvent
+      && static_cast<size_t>(type) < sizeof(names) / sizeof(names[0]))
+    return names[type];
+  return "(extension)";
+}
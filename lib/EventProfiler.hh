@@ -0,0 +1,123 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// EventProfiler.hh for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __EventProfiler_hh
+#define   __EventProfiler_hh
+
+#include "Util.hh"
+
+#include <X11/Xlib.h>
+
+#include <map>
+#include <typeinfo>
+
+namespace bt {
+
+  /*
+    Measures how long the event loop spends dispatching each X event.
+    It keeps dispatch time histograms per event type and per handler
+    class, a histogram of the event queue depth, and the slowest
+    events seen.  Events that take longer than the stall threshold
+    are reported on stderr as they happen.
+  */
+  class EventProfiler : public NoCopy {
+  public:
+    enum {
+      // dispatch times: less than 16 << n microseconds, the last
+      // bucket holds everything slower
+      TimeCount = 16,
+      // queue depths: less than 1 << n events, the last bucket holds
+      // everything deeper
+      DepthCount = 10,
+      // the number of slowest events that are kept
+      SlowestCount = 32,
+      // core event types, followed by one bucket for extension events
+      TypeCount = LASTEvent + 1
+    };
+
+    struct SlowEvent {
+      int type;
+      Window window;
+      // the typeid() name of the handler, or zero if there was none
+      const char *handler;
+      long usecs;
+    };
+
+    explicit EventProfiler(const std::string &app_name);
+
+    /*
+      Sets the time in milliseconds after which a single event is
+      reported as a stall.  Zero, the default, disables the reports.
+    */
+    inline void setStallThreshold(long msecs)
+    { stall_threshold = msecs; }
+    inline long stallThreshold(void) const
+    { return stall_threshold; }
+
+    /*
+      Records an event of {type} for {window}, delivered to an object
+      of class {handler} (which may be zero) while {depth} events were
+      queued, that took {usecs} microseconds to process.
+    */
+    void record(int type, Window window, const std::type_info *handler,
+                unsigned int depth, long usecs);
+
+    /*
+      Resets all counters to zero.
+    */
+    void reset(void);
+
+    /*
+      Writes the histograms and the slowest events in human readable
+      form to the specified file, after the number of event loop
+      {wakeups} and how many of them fired timers (see
+      Application::wakeups()).  Returns false if the file could not be
+      written.
+    */
+    bool dump(const std::string &filename, unsigned long wakeups,
+              unsigned long timer_wakeups) const;
+
+    static const char *typeName(int type);
+
+  private:
+    struct Histogram {
+      unsigned long counts[TimeCount];
+    };
+    typedef std::map<const char *, Histogram> HandlerMap;
+
+    std::string _app_name;
+    long stall_threshold;
+
+    unsigned long events;
+    unsigned long by_type[TypeCount][TimeCount];
+    HandlerMap by_handler;
+    unsigned long by_depth[DepthCount];
+
+    SlowEvent slowest[SlowestCount];
+    unsigned int slowest_count;
+  };
+
+} // namespace bt
+
+#endif // __EventProfiler_hh
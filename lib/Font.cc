@@ -28,7 +28,10 @@
 #include "Display.hh"
 #include "Pen.hh"
 #include "Resource.hh"
+#include "Thread.hh"
 
+#include <algorithm>
+#include <list>
 #include <map>
 #include <vector>
 
@@ -53,6 +56,27 @@ static const char * const defaultXftFont = "sans-serif";
 
 namespace bt {
 
+#ifdef XFT
+  // fontconfig matching for FontCache::prefetchXftFont()
+  class XftMatchJob : public BackgroundJob {
+  public:
+    explicit XftMatchJob(FcPattern *pattern)
+      : _pattern(pattern), _match(0)
+    { }
+    ~XftMatchJob(void);
+
+    // waits for the job, the caller owns the returned pattern
+    FcPattern *takeMatch(void);
+
+  protected:
+    void run(void);
+
+  private:
+    FcPattern *_pattern;
+    FcPattern *_match;
+  };
+#endif
+
   class FontCache {
   public:
     FontCache(const Display &dpy);
@@ -61,12 +85,36 @@ namespace bt {
     XFontSet findFontSet(const std::string &fontsetname);
 #ifdef XFT
     XftFont *findXftFont(const std::string &fontname, unsigned int screen);
+
+    /*
+      Starts matching the font on a background thread.  The match is
+      used by the next findXftFont() call for the same font.
+    */
+    void prefetchXftFont(const std::string &fontname, unsigned int screen);
+
+    // the pattern that XftFontOpenName() matches
+    FcPattern *xftPattern(const std::string &fontname, unsigned int screen);
+    bool isCoreFont(const std::string &fontname);
 #endif
 
     void release(const std::string &fontname, unsigned int screen);
 
     void clear(bool force);
 
+    /*
+      Finds the textRect() of text in the specified font (an XftFont
+      or XFontSet) on the given screen.  Returns false if the extents
+      are not cached.
+    */
+    bool findExtent(const void *font, unsigned int screen,
+                    const std::string &utf8, Rect &rect);
+    /*
+      Caches the textRect() of text.  Only the most recently used
+      extents are kept.
+    */
+    void insertExtent(const void *font, unsigned int screen,
+                      const std::string &utf8, const Rect &rect);
+
     const Display &_display;
 #ifdef XFT
     bool xft_initialized;
@@ -109,9 +157,45 @@ namespace bt {
     typedef std::map<FontName,FontRef> Cache;
     typedef Cache::value_type CacheItem;
     Cache cache;
+
+#ifdef XFT
+    typedef std::map<FontName,XftMatchJob *> PendingMatches;
+    PendingMatches pending;
+#endif
+
+    struct ExtentKey {
+      const void *font;
+      unsigned int screen;
+      unsigned long hash;
+      inline bool operator<(const ExtentKey &other) const {
+        if (font != other.font)
+          return font < other.font;
+        if (screen != other.screen)
+          return screen < other.screen;
+        return hash < other.hash;
+      }
+    };
+
+    struct Extent {
+      ExtentKey key;
+      std::string utf8;
+      Rect rect;
+    };
+
+    // most recently used first
+    typedef std::list<Extent> ExtentList;
+    typedef std::map<ExtentKey, ExtentList::iterator> ExtentIndex;
+    ExtentList extents;
+    ExtentIndex extent_index;
+
+    unsigned long extent_hits, extent_misses;
   };
 
 
+  // the number of text extents kept by the font cache
+  static const unsigned int maxExtents = 512u;
+
+
   static FontCache *fontcache = 0;
 
 
@@ -173,7 +257,7 @@ namespace bt {
 
 
 bt::FontCache::FontCache(const Display &dpy)
-  : _display(dpy)
+  : _display(dpy), extent_hits(0ul), extent_misses(0ul)
 {
 #ifdef XFT
   xft_initialized = XftInit(NULL) && XftInitFtLibrary();
@@ -182,7 +266,15 @@ bt::FontCache::FontCache(const Display &dpy)
 
 
 bt::FontCache::~FontCache(void)
-{ clear(true); }
+{
+  clear(true);
+
+#ifdef XFT
+  PendingMatches::iterator it = pending.begin();
+  for (; it != pending.end(); ++it)
+    delete it->second;
+#endif
+}
 
 
 XFontSet bt::FontCache::findFontSet(const std::string &fontsetname) {
@@ -292,28 +384,39 @@ XftFont *bt::FontCache::findXftFont(const std::string &fontname,
   }
 
   XftFont *ret = 0;
-  bool use_xft = true;
-  int unused = 0;
-  char **list =
-    XListFonts(_display.XDisplay(), fontname.c_str(), 1, &unused);
-  if (list != NULL) {
-    // if fontname is a valid XLFD or alias, use a fontset instead of Xft
-    use_xft = false;
-    XFreeFontNames(list);
+  FcPattern *match = 0;
+  PendingMatches::iterator p = pending.find(fn);
+  if (p != pending.end()) {
+    match = p->second->takeMatch();
+    delete p->second;
+    pending.erase(p);
+  }
+
+  // if fontname is a valid XLFD or alias, use a fontset instead of Xft
+  const bool use_xft = match || !isCoreFont(fontname);
 
 #ifdef FONTCACHE_DEBUG
+  if (!use_xft) {
     fprintf(stderr, gettext("bt::FontCache: skp Xft%u '%s'\n"),
             screen, fontname.c_str());
-#endif // FONTCACHE_DEBUG
   }
+#endif // FONTCACHE_DEBUG
 
   if (use_xft) {
-    // Xft can't do antialiasing on 8bpp very well
-    std::string n = fontname;
-    if (_display.screenInfo(screen).depth() <= 8)
-      n += ":antialias=false";
+    if (!match) {
+      FcPattern * const pattern = xftPattern(fontname, screen);
+      if (pattern) {
+        FcResult result;
+        match = FcFontMatch(0, pattern, &result);
+        FcPatternDestroy(pattern);
+      }
+    }
 
-    ret = XftFontOpenName(_display.XDisplay(), screen, n.c_str());
+    if (match) {
+      ret = XftFontOpenPattern(_display.XDisplay(), match);
+      if (ret == NULL)
+        FcPatternDestroy(match);
+    }
     if (ret == NULL) {
       // Xft will never return NULL, but it doesn't hurt to be cautious
       fprintf(stderr, gettext("bt::Font: couldn't load Xft%u '%s'\n"),
@@ -322,6 +425,20 @@ XftFont *bt::FontCache::findXftFont(const std::string &fontname,
     }
     assert(ret != NULL);
 
+    /*
+      Xft rasterizes glyphs the first time they are drawn.  Load the
+      printable ASCII range now, so that drawing the first titles and
+      menus does not stall.
+    */
+    FT_UInt glyphs[0x7f - 0x20];
+    int count = 0;
+    for (FcChar32 c = 0x20; c < 0x7f; ++c) {
+      const FT_UInt glyph = XftCharIndex(_display.XDisplay(), ret, c);
+      if (glyph)
+        glyphs[count++] = glyph;
+    }
+    XftFontLoadGlyphs(_display.XDisplay(), ret, FcTrue, glyphs, count);
+
 #ifdef FONTCACHE_DEBUG
     fprintf(stderr, gettext("bt::FontCache: add Xft%u '%s'\n"),
             screen, fontname.c_str());
@@ -331,6 +448,90 @@ XftFont *bt::FontCache::findXftFont(const std::string &fontname,
   cache.insert(CacheItem(fn, FontRef(ret)));
   return ret;
 }
+
+
+void bt::FontCache::prefetchXftFont(const std::string &fontname,
+                                    unsigned int screen) {
+  if (!xft_initialized)
+    return;
+
+  if (fontname.empty()) {
+    prefetchXftFont(defaultXftFont, screen);
+    return;
+  }
+
+  FontName fn(fontname, screen);
+  if (cache.find(fn) != cache.end()
+      || pending.find(fn) != pending.end()
+      || isCoreFont(fontname))
+    return;
+
+  FcPattern * const pattern = xftPattern(fontname, screen);
+  if (!pattern)
+    return;
+
+#ifdef FONTCACHE_DEBUG
+  fprintf(stderr, gettext("bt::FontCache: pre Xft%u '%s'\n"),
+          screen, fontname.c_str());
+#endif // FONTCACHE_DEBUG
+
+  XftMatchJob * const job = new XftMatchJob(pattern);
+  pending.insert(PendingMatches::value_type(fn, job));
+  job->start();
+}
+
+
+FcPattern *bt::FontCache::xftPattern(const std::string &fontname,
+                                     unsigned int screen) {
+  // Xft can't do antialiasing on 8bpp very well
+  std::string n = fontname;
+  if (_display.screenInfo(screen).depth() <= 8)
+    n += ":antialias=false";
+
+  FcPattern * const pattern =
+    FcNameParse(reinterpret_cast<const FcChar8 *>(n.c_str()));
+  if (!pattern)
+    return 0;
+
+  // XftDefaultSubstitute() reads the X resources, so only the
+  // matching itself is done on the background thread
+  FcConfigSubstitute(0, pattern, FcMatchPattern);
+  XftDefaultSubstitute(_display.XDisplay(), screen, pattern);
+  return pattern;
+}
+
+
+bool bt::FontCache::isCoreFont(const std::string &fontname) {
+  int unused = 0;
+  char **list =
+    XListFonts(_display.XDisplay(), fontname.c_str(), 1, &unused);
+  if (list == NULL)
+    return false;
+  XFreeFontNames(list);
+  return true;
+}
+
+
+bt::XftMatchJob::~XftMatchJob(void) {
+  wait();
+  FcPatternDestroy(_pattern);
+  if (_match)
+    FcPatternDestroy(_match);
+}
+
+
+FcPattern *bt::XftMatchJob::takeMatch(void) {
+  wait();
+  FcPattern * const match = _match;
+  _match = 0;
+  return match;
+}
+
+
+void bt::XftMatchJob::run(void) {
+  FcResult result;
+  _match = FcFontMatch(0, _pattern, &result);
+}
 #endif
 
 
@@ -373,6 +574,10 @@ void bt::FontCache::clear(bool force) {
       continue;
     }
 
+    // the font may be reallocated at the same address
+    extents.clear();
+    extent_index.clear();
+
 #ifdef FONTCACHE_DEBUG
     fprintf(stderr, gettext("bt::FontCache: fre      '%s'\n"), it->first.name.c_str());
 #endif // FONTCACHE_DEBUG
@@ -394,6 +599,62 @@ void bt::FontCache::clear(bool force) {
 }
 
 
+// FNV-1a
+static unsigned long hashText(const std::string &utf8) {
+  unsigned long hash = 2166136261ul;
+  for (std::string::const_iterator it = utf8.begin(); it != utf8.end(); ++it)
+    hash = ((hash ^ static_cast<unsigned char>(*it)) * 16777619ul)
+           & 0xfffffffful;
+  return hash;
+}
+
+
+bool bt::FontCache::findExtent(const void *font, unsigned int screen,
+                               const std::string &utf8, Rect &rect) {
+  ExtentKey key;
+  key.font = font;
+  key.screen = screen;
+  key.hash = hashText(utf8);
+
+  ExtentIndex::iterator it = extent_index.find(key);
+  if (it == extent_index.end() || it->second->utf8 != utf8) {
+    ++extent_misses;
+    return false;
+  }
+
+  ++extent_hits;
+  extents.splice(extents.begin(), extents, it->second);
+  rect = it->second->rect;
+  return true;
+}
+
+
+void bt::FontCache::insertExtent(const void *font, unsigned int screen,
+                                 const std::string &utf8, const Rect &rect) {
+  Extent extent;
+  extent.key.font = font;
+  extent.key.screen = screen;
+  extent.key.hash = hashText(utf8);
+  extent.utf8 = utf8;
+  extent.rect = rect;
+
+  // replaces a different text with the same hash
+  ExtentIndex::iterator it = extent_index.find(extent.key);
+  if (it != extent_index.end()) {
+    extents.erase(it->second);
+    extent_index.erase(it);
+  }
+
+  extents.push_front(extent);
+  extent_index.insert(ExtentIndex::value_type(extent.key, extents.begin()));
+
+  if (extents.size() > maxExtents) {
+    extent_index.erase(extents.back().key);
+    extents.pop_back();
+  }
+}
+
+
 XFontSet bt::Font::fontSet(void) const {
   if (_fontset)
     return _fontset;
@@ -440,6 +701,22 @@ void bt::Font::clearCache(void)
 { fontcache->clear(false); }
 
 
+void bt::Font::prefetch(const std::string &fontname, unsigned int screen) {
+#ifdef XFT
+  fontcache->prefetchXftFont(fontname, screen);
+#else
+  (void) fontname;
+  (void) screen;
+#endif
+}
+
+
+void bt::Font::extentStatistics(unsigned long &hits, unsigned long &misses) {
+  hits = fontcache->extent_hits;
+  misses = fontcache->extent_misses;
+}
+
+
 unsigned int bt::textHeight(unsigned int screen, const Font &font) {
 #ifdef XFT
   const XftFont * const f = font.xftFont(screen);
@@ -464,32 +741,58 @@ unsigned int bt::textIndent(unsigned int screen, const Font &font) {
 
 
 bt::Rect bt::textRect(unsigned int screen, const Font &font,
-                      const bt::ustring &text) {
+                      const bt::ustring &text)
+{ return textRect(screen, font, Utf8String(text)); }
+
+
+bt::Rect bt::textRect(unsigned int screen, const Font &font,
+                      const bt::Utf8String &text) {
   const unsigned int indent = textIndent(screen, font);
+  const std::string &utf8 = text.utf8();
+
+  Rect rect;
 
 #ifdef XFT
   XftFont * const f = font.xftFont(screen);
   if (f) {
+    if (fontcache->findExtent(f, screen, utf8, rect))
+      return rect;
+
     XGlyphInfo xgi;
-    XftTextExtents32(fontcache->_display.XDisplay(), f,
-                     reinterpret_cast<const FcChar32 *>(text.data()),
-                     text.length(), &xgi);
-    return Rect(xgi.x, 0, xgi.width - xgi.x + (indent * 2),
+    XftTextExtentsUtf8(fontcache->_display.XDisplay(), f,
+                       reinterpret_cast<const FcChar8 *>(utf8.data()),
+                       utf8.length(), &xgi);
+    rect = Rect(xgi.x, 0, xgi.width - xgi.x + (indent * 2),
                 f->ascent + f->descent);
+    fontcache->insertExtent(f, screen, utf8, rect);
+    return rect;
   }
 #endif
 
+  // fontsets have no screen
+  const XFontSet fs = font.fontSet();
+  if (fontcache->findExtent(fs, ~0u, utf8, rect))
+    return rect;
+
   const std::string str = toLocale(text);
   XRectangle ink, unused;
-  XmbTextExtents(font.fontSet(), str.c_str(), str.length(), &ink, &unused);
-  return Rect(ink.x, 0, ink.width - ink.x + (indent * 2),
-              XExtentsOfFontSet(font.fontSet())->max_ink_extent.height);
+  XmbTextExtents(fs, str.c_str(), str.length(), &ink, &unused);
+  rect = Rect(ink.x, 0, ink.width - ink.x + (indent * 2),
+              XExtentsOfFontSet(fs)->max_ink_extent.height);
+  fontcache->insertExtent(fs, ~0u, utf8, rect);
+  return rect;
 }
 
 
 void bt::drawText(const Font &font, const Pen &pen,
                   Drawable drawable, const Rect &rect,
-                  Alignment alignment, const bt::ustring &text) {
+                  Alignment alignment, const bt::ustring &text)
+{ drawText(font, pen, drawable, rect, alignment, Utf8String(text)); }
+
+
+void bt::drawText(const Font &font, const Pen &pen,
+                  Drawable drawable, const Rect &rect,
+                  Alignment alignment, const bt::Utf8String &text) {
   Rect tr = textRect(pen.screen(), font, text);
   unsigned int indent = textIndent(pen.screen(), font);
 
@@ -528,10 +831,10 @@ void bt::drawText(const Font &font, const Pen &pen,
     col.color.alpha = 0xffff;
     col.pixel = pen.color().pixel(pen.screen());
 
-    XftDrawString32(pen.xftDraw(drawable), &col, f,
-                    tr.x() + indent, tr.y() + f->ascent,
-                    reinterpret_cast<const FcChar32 *>(text.data()),
-                    text.length());
+    XftDrawStringUtf8(pen.xftDraw(drawable), &col, f,
+                      tr.x() + indent, tr.y() + f->ascent,
+                      reinterpret_cast<const FcChar8 *>(text.utf8().data()),
+                      text.utf8().length());
     return;
   }
 #endif
@@ -559,6 +862,69 @@ bt::ustring bt::ellideText(const bt::ustring &text, size_t count,
 }
 
 
+bt::ustring bt::ellideText(const bt::Utf8String &text, size_t count,
+                           const bt::ustring &ellide) {
+  const std::string::size_type len = text.length();
+  if (len <= count)
+    return text.unicode();
+
+  assert(ellide.length() < (count / 2));
+
+  // the same head and tail as above
+  const std::string::size_type head = (count / 2) - (ellide.length() / 2);
+  const std::string::size_type tail =
+    (count / 2) - ((ellide.length() / 2) + 1);
+  bt::ustring ret = text.unicode(0, head);
+  ret += ellide;
+  ret += text.unicode(len - tail, tail);
+  return ret;
+}
+
+
+/*
+ * Stores the advance of each character of text, followed by the total,
+ * in prefix sums.  Returns false if the advances cannot be determined.
+ */
+static bool textAdvances(unsigned int screen, const bt::Font &font,
+                         const bt::ustring &text,
+                         std::vector<int> &prefix) {
+  prefix.assign(text.length() + 1, 0);
+
+#ifdef XFT
+  XftFont * const f = font.xftFont(screen);
+  if (f) {
+    for (bt::ustring::size_type i = 0; i < text.length(); ++i) {
+      XGlyphInfo xgi;
+      XftTextExtents32(bt::fontcache->_display.XDisplay(), f,
+                       reinterpret_cast<const FcChar32 *>(&text[i]), 1,
+                       &xgi);
+      prefix[i + 1] = prefix[i] + xgi.xOff;
+    }
+    return true;
+  }
+#else
+  (void) screen;
+#endif
+
+  if (text.empty())
+    return true;
+
+  const std::string str = bt::toLocale(text);
+  std::vector<XRectangle> ink(text.length()), logical(text.length());
+  XRectangle overall_ink, overall_logical;
+  int count = 0;
+  if (!XmbTextPerCharExtents(font.fontSet(), str.c_str(), str.length(),
+                             &ink[0], &logical[0], text.length(), &count,
+                             &overall_ink, &overall_logical)
+      || static_cast<bt::ustring::size_type>(count) != text.length())
+    return false;
+
+  for (bt::ustring::size_type i = 0; i < text.length(); ++i)
+    prefix[i + 1] = prefix[i] + logical[i].width;
+  return true;
+}
+
+
 bt::ustring bt::ellideText(const bt::ustring &text,
                            unsigned int max_width,
                            const bt::ustring &ellide,
@@ -566,17 +932,65 @@ bt::ustring bt::ellideText(const bt::ustring &text,
                            const bt::Font &font) {
   bt::ustring visible = text;
   bt::Rect r = bt::textRect(screen, font, visible);
+  if (r.width() <= max_width)
+    return visible;
+
+  const int min_c = (ellide.length() * 3) - 1;
+  const int len = text.length();
+  if (len - 1 <= min_c)
+    return ellide; // couldn't ellide enough
 
-  if (r.width() > max_width) {
-    const int min_c = (ellide.length() * 3) - 1;
-    int c = visible.length();
-    while (--c > min_c && r.width() > max_width) {
-      visible = bt::ellideText(text, c, ellide);
-      r = bt::textRect(screen, font, visible);
+  /*
+    Removing more characters never makes the text wider, so we
+    binary search for the longest ellided text that fits, estimating
+    its width from the character advances.  The estimate ignores
+    kerning and ink bearings, so the result is corrected with
+    textRect() below, which normally takes a single step.
+  */
+  int c = len;
+  std::vector<int> prefix, ellide_prefix;
+  if (!ellide.empty()
+      && textAdvances(screen, font, text, prefix)
+      && textAdvances(screen, font, ellide, ellide_prefix)) {
+    const int indent = textIndent(screen, font) * 2;
+    const int e = ellide.length();
+    int lo = min_c, hi = len - 1;
+    while (lo < hi) {
+      // see ellideText() above for the head and tail lengths
+      const int mid = lo + ((hi - lo + 1) / 2);
+      const int head = (mid / 2) - (e / 2);
+      const int tail = (mid / 2) - (e / 2) - 1;
+      const int width = indent + prefix[head] + ellide_prefix[e]
+                        + prefix[len] - prefix[len - tail];
+      if (width <= static_cast<int>(max_width))
+        lo = mid;
+      else
+        hi = mid - 1;
     }
-    if (c <= min_c)
-      visible = ellide; // couldn't ellide enough
+    c = std::max(lo, min_c + 1);
+
+    visible = bt::ellideText(text, c, ellide);
+    r = bt::textRect(screen, font, visible);
+    if (r.width() <= max_width) {
+      // the estimate may be too wide, try to keep more of the text
+      while (c + 1 < len) {
+        const bt::ustring longer = bt::ellideText(text, c + 1, ellide);
+        const bt::Rect lr = bt::textRect(screen, font, longer);
+        if (lr.width() > max_width)
+          break;
+        ++c;
+        visible = longer;
+      }
+      return visible;
+    }
+  }
+
+  while (--c > min_c && r.width() > max_width) {
+    visible = bt::ellideText(text, c, ellide);
+    r = bt::textRect(screen, font, visible);
   }
+  if (c <= min_c)
+    visible = ellide; // couldn't ellide enough
 
   return visible;
 }
@@ -53,10 +53,15 @@ namespace bt {
 
   Rect textRect(unsigned int screen, const Font &font,
                 const bt::ustring &text);
+  Rect textRect(unsigned int screen, const Font &font,
+                const Utf8String &text);
 
   void drawText(const Font &font, const Pen &pen,
                 Drawable drawable, const Rect &rect,
                 Alignment alignment, const ustring &text);
+  void drawText(const Font &font, const Pen &pen,
+                Drawable drawable, const Rect &rect,
+                Alignment alignment, const Utf8String &text);
 
   /*
    * Take a string and make it 'count' chars long by removing the
@@ -64,6 +69,11 @@ namespace bt {
    */
   ustring ellideText(const ustring &text, size_t count,
                      const ustring &ellide);
+  /*
+   * As above, converting only the characters that are kept.
+   */
+  ustring ellideText(const Utf8String &text, size_t count,
+                     const ustring &ellide);
 
   /*
    * Take a string and make no more than 'max_width' pixels wide by
@@ -85,6 +95,19 @@ namespace bt {
   public:
     static void clearCache(void);
 
+    /*
+      Starts matching the named Xft font for the given screen on a
+      background thread, so that loading it later does not wait for
+      fontconfig.  Does nothing for core fonts.
+    */
+    static void prefetch(const std::string &fontname, unsigned int screen);
+
+    /*
+      Returns the number of textRect() calls answered from the extent
+      cache, and the number that had to measure the text.
+    */
+    static void extentStatistics(unsigned long &hits, unsigned long &misses);
+
     explicit inline Font(const std::string &name = std::string())
       : _fontname(name), _fontset(0), _xftfont(0), _screen(~0u)
     { }
@@ -27,6 +27,8 @@
 #include "Display.hh"
 #include "Pen.hh"
 #include "Texture.hh"
+#include "Thread.hh"
+#include "Trace.hh"
 
 #include <algorithm>
 #include <vector>
@@ -37,9 +39,17 @@
 #  include <sys/types.h>
 #  include <sys/ipc.h>
 #  include <sys/shm.h>
+#  include <errno.h>
 #  include <unistd.h>
 #  include <X11/extensions/XShm.h>
 #endif // MITSHM
+#ifdef    XRENDER
+#  include <X11/extensions/Xrender.h>
+#endif // XRENDER
+#if defined(SIMD) && (defined(__i386__) || defined(__x86_64__))
+#  define BT_X86_SIMD
+#  include <immintrin.h>
+#endif // SIMD
 
 #include <assert.h>
 #include <math.h>
@@ -79,6 +89,8 @@ namespace bt {
   public:
     XColorTable(const Display &dpy, unsigned int screen,
                 unsigned int maxColors);
+    // an offscreen TrueColor visual
+    explicit XColorTable(const ImageFormat &format);
     ~XColorTable(void);
 
     inline bt::DitherMode ditherMode(void) const
@@ -95,14 +107,91 @@ namespace bt {
                         unsigned int green,
                         unsigned int blue);
 
+    /*
+      Converts one row of RGB data into XImage pixel data.  A packer
+      returned for a dithered image expects channel values that have
+      already been passed through map(); otherwise it maps the full
+      8-bit values itself.
+    */
+    typedef void (*RowPacker)(const XColorTable &colortable,
+                              const RGB *row, unsigned int width,
+                              unsigned char *pixel_data);
+    RowPacker packer(unsigned int bit_depth, bool dithered) const;
+
   private:
-    const Display &_dpy;
+    void createTables(void);
+
+    const Display *_dpy;
     unsigned int _screen;
     int visual_class;
     unsigned int n_red, n_green, n_blue;
     int red_shift, green_shift, blue_shift;
 
     std::vector<unsigned long> colors;
+
+    // map() followed by the first step of pixel() for each 8-bit
+    // channel value: the shifted channel for TrueColor and DirectColor,
+    // the (weighted) contribution to the colors index otherwise
+    unsigned long red_table[256], green_table[256], blue_table[256];
+
+    // pixel lookups, instantiated once per row by the row packers
+    struct TrueColorPixel {
+      int rs, gs, bs;
+      explicit TrueColorPixel(const XColorTable &t)
+        : rs(t.red_shift), gs(t.green_shift), bs(t.blue_shift) { }
+      inline unsigned long operator()(unsigned int r, unsigned int g,
+                                      unsigned int b) const
+      { return (r << rs) | (g << gs) | (b << bs); }
+    };
+    struct ColorCubePixel {
+      const unsigned long *colors;
+      unsigned int rm, gm;
+      explicit ColorCubePixel(const XColorTable &t)
+        : colors(&t.colors[0]), rm(t.n_green * t.n_blue), gm(t.n_blue) { }
+      inline unsigned long operator()(unsigned int r, unsigned int g,
+                                      unsigned int b) const
+      { return colors[(r * rm) + (g * gm) + b]; }
+    };
+    struct GrayPixel {
+      const unsigned long *colors;
+      explicit GrayPixel(const XColorTable &t) : colors(&t.colors[0]) { }
+      inline unsigned long operator()(unsigned int r, unsigned int g,
+                                      unsigned int b) const
+      { return colors[(r * 30 + g * 59 + b * 11) / 100]; }
+    };
+    struct TrueColorMap {
+      const unsigned long *rt, *gt, *bt;
+      explicit TrueColorMap(const XColorTable &t)
+        : rt(t.red_table), gt(t.green_table), bt(t.blue_table) { }
+      inline unsigned long operator()(unsigned int r, unsigned int g,
+                                      unsigned int b) const
+      { return rt[r] | gt[g] | bt[b]; }
+    };
+    struct ColorCubeMap {
+      const unsigned long *colors, *rt, *gt, *bt;
+      explicit ColorCubeMap(const XColorTable &t)
+        : colors(&t.colors[0]),
+          rt(t.red_table), gt(t.green_table), bt(t.blue_table) { }
+      inline unsigned long operator()(unsigned int r, unsigned int g,
+                                      unsigned int b) const
+      { return colors[rt[r] + gt[g] + bt[b]]; }
+    };
+    struct GrayMap {
+      const unsigned long *colors, *rt, *gt, *bt;
+      explicit GrayMap(const XColorTable &t)
+        : colors(&t.colors[0]),
+          rt(t.red_table), gt(t.green_table), bt(t.blue_table) { }
+      inline unsigned long operator()(unsigned int r, unsigned int g,
+                                      unsigned int b) const
+      { return colors[(rt[r] + gt[g] + bt[b]) / 100]; }
+    };
+    // 8 bits per channel at the usual positions, no lookups at all
+    struct RGB888Pixel {
+      explicit RGB888Pixel(const XColorTable &) { }
+      inline unsigned long operator()(unsigned int r, unsigned int g,
+                                      unsigned int b) const
+      { return (r << 16) | (g << 8) | b; }
+    };
   };
 
 
@@ -128,11 +217,43 @@ namespace bt {
 
 
 #ifdef MITSHM
-  static XShmSegmentInfo shm_info;
+  /*
+    Shared memory segments are kept attached to the X server and
+    reused for later renders.  Segments are grouped in size classes
+    (powers of two, starting at shm_min_size) with a fixed number of
+    segments per class.
+
+    The X server reads a segment asynchronously after XShmPutImage, so
+    a segment is only handed out again once the server has processed
+    the request that last used it (this is known without a round trip
+    from the sequence number of the last reply or event read).  Only
+    if every segment in a size class is still busy do we have to wait
+    for the server.
+
+    Segments are released by shutdownShm(), or when the kernel refuses
+    to create a new segment, in which case all idle segments are
+    released and the creation is retried.  Any other failure disables
+    MIT-SHM, so that a system without usable shared memory does not
+    retry on every render.
+  */
+  struct ShmSegment {
+    XShmSegmentInfo info; // must be first, see destroyShmImage()
+    size_t size;
+    unsigned long serial;
+    unsigned long last_use;
+  };
+
+  typedef std::vector<ShmSegment *> ShmSegmentList;
+  static ShmSegmentList shm_pool;
+  static unsigned long shm_clock = 0ul;
   static bool use_shm = false;
-  static bool shm_attached = false;
-  static int shm_id = -1;
-  static char *shm_addr = reinterpret_cast<char *>(-1);
+  static bool shm_test_attach = true;
+
+  static const size_t shm_min_size = 64u * 1024u;
+  static const size_t shm_max_size = 16u * 1024u * 1024u;
+  // the number of segments kept per size class, so that each class
+  // holds at most shm_class_limit bytes (but at least 2 segments)
+  static const size_t shm_class_limit = 1024u * 1024u;
 
 
   static int handleShmError(::Display *, XErrorEvent *) {
@@ -149,81 +270,103 @@ namespace bt {
   }
 
 
-  void destroyShmImage(const Display &display, XImage *image) {
-    // tell the X server to detach
-    if (shm_attached) {
-      XShmDetach(display.XDisplay(), &shm_info);
+  static inline bool shmSegmentBusy(const Display &display,
+                                    const ShmSegment *seg) {
+    // sequence numbers wrap, so compare the difference
+    return (static_cast<long>(LastKnownRequestProcessed(display.XDisplay())
+                              - seg->serial) < 0l);
+  }
+
+
+  static void freeShmSegment(const Display &display, ShmSegment *seg) {
+    XShmDetach(display.XDisplay(), &seg->info);
+
+    // the server keeps its own attachment until it processes the
+    // detach above, the segment is destroyed after that
+    shmdt(seg->info.shmaddr);
+    shmctl(seg->info.shmid, IPC_RMID, 0);
+
+    delete seg;
+  }
 
-      // wait for the server to render the image and detach the memory
-      // segment
-      XSync(display.XDisplay(), False);
 
-      shm_attached = false;
+  static void releaseIdleShmSegments(const Display &display) {
+    ShmSegmentList::iterator it = shm_pool.begin();
+    while (it != shm_pool.end()) {
+      if (shmSegmentBusy(display, *it)) {
+        ++it;
+        continue;
+      }
+      freeShmSegment(display, *it);
+      it = shm_pool.erase(it);
     }
+  }
 
-    // detach shared memory segment
-    if (shm_addr != reinterpret_cast<char *>(-1))
-      shmdt(shm_addr);
-    shm_addr = reinterpret_cast<char *>(-1);
 
-    // destroy shared memory id
-    if (shm_id != -1)
-      shmctl(shm_id, IPC_RMID, 0);
-    shm_id = -1;
+  void shutdownShm(const Display &display) {
+    if (shm_pool.empty())
+      return;
 
-    // destroy XImage
-    image->data = 0;
-    XDestroyImage(image);
+    // wait for the server to finish with all segments
+    XSync(display.XDisplay(), False);
+
+    ShmSegmentList::iterator it = shm_pool.begin();
+    const ShmSegmentList::iterator end = shm_pool.end();
+    for (; it != end; ++it)
+      freeShmSegment(display, *it);
+    shm_pool.clear();
+
+    XSync(display.XDisplay(), False);
   }
 
 
-  XImage *createShmImage(const Display &display, const ScreenInfo &screeninfo,
-                         unsigned int width, unsigned int height) {
-    if (!use_shm)
-      return 0;
+  // true if errno says that the system ran out of shared memory
+  static inline bool shmExhausted(void)
+  { return (errno == ENOSPC || errno == ENOMEM || errno == EMFILE); }
 
-    // use MIT-SHM extension
-    XImage *image = XShmCreateImage(display.XDisplay(), screeninfo.visual(),
-                                    screeninfo.depth(), ZPixmap, 0,
-                                    &shm_info, width, height);
-    if (!image)
-      return 0;
 
-    // get shared memory id
-    unsigned int usage = image->bytes_per_line * image->height;
-    shm_id = shmget(IPC_PRIVATE, usage, IPC_CREAT | 0644);
+  static ShmSegment *createShmSegment(const Display &display, size_t size) {
+    int shm_id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shm_id == -1 && shmExhausted() && !shm_pool.empty()) {
+      // out of shared memory, give back what we are not using and retry
+      releaseIdleShmSegments(display);
+      shm_id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    }
     if (shm_id == -1) {
 #ifdef MITSHM_DEBUG
-      perror("bt::createShmImage: shmget");
+      perror("bt::createShmSegment: shmget");
 #endif // MITSHM_DEBUG
-
-      use_shm = false;
-      XDestroyImage(image);
+      if (!shmExhausted())
+        use_shm = false;
       return 0;
     }
 
-    // attached shared memory segment
-    shm_addr = static_cast<char *>(shmat(shm_id, 0, 0));
+    // attach shared memory segment
+    char *shm_addr = static_cast<char *>(shmat(shm_id, 0, 0));
     if (shm_addr == reinterpret_cast<char *>(-1)) {
 #ifdef MITSHM_DEBUG
-      perror("bt::createShmImage: shmat");
+      perror("bt::createShmSegment: shmat");
 #endif // MITSHM_DEBUG
+      if (!shmExhausted())
+        use_shm = false;
 
-      use_shm = false;
-      destroyShmImage(display, image);
+      shmctl(shm_id, IPC_RMID, 0);
       return 0;
     }
 
-    // tell the X server to attach
-    shm_info.shmid = shm_id;
-    shm_info.shmaddr = shm_addr;
-    shm_info.readOnly = True;
+    ShmSegment *seg = new ShmSegment;
+    seg->info.shmid = shm_id;
+    seg->info.shmaddr = shm_addr;
+    seg->info.readOnly = True;
+    seg->size = size;
+    seg->serial = 0ul;
+    seg->last_use = 0ul;
 
-    static bool test_server_attach = true;
-    if (test_server_attach) {
+    // tell the X server to attach
+    if (shm_test_attach) {
       // never checked if the X server can do shared memory...
       XErrorHandler old_handler = XSetErrorHandler(handleShmError);
-      XShmAttach(display.XDisplay(), &shm_info);
+      XShmAttach(display.XDisplay(), &seg->info);
       XSync(display.XDisplay(), False);
       XSetErrorHandler(old_handler);
 
@@ -231,35 +374,139 @@ namespace bt {
         // the X server failed to attach the shm segment
 
 #ifdef MITSHM_DEBUG
-        fprintf(stderr, gettext("bt::createShmImage: X server failed to attach\n"));
+        fprintf(stderr, gettext("bt::createShmSegment: X server failed to attach\n"));
 #endif // MITSHM_DEBUG
 
-        destroyShmImage(display, image);
+        shmdt(shm_addr);
+        shmctl(shm_id, IPC_RMID, 0);
+        delete seg;
         return 0;
       }
 
-      test_server_attach = false;
+      shm_test_attach = false;
     } else {
       // we know the X server can attach to the memory segment
-      XShmAttach(display.XDisplay(), &shm_info);
+      XShmAttach(display.XDisplay(), &seg->info);
+    }
+
+    // mark the segment as idle
+    seg->serial = NextRequest(display.XDisplay()) - 1;
+    return seg;
+  }
+
+
+  static ShmSegment *findShmSegment(const Display &display, size_t usage) {
+    size_t size = shm_min_size;
+    while (size < usage)
+      size <<= 1;
+
+    ShmSegment *idle = 0, *oldest = 0;
+    size_t count = 0u;
+    ShmSegmentList::const_iterator it = shm_pool.begin();
+    const ShmSegmentList::const_iterator end = shm_pool.end();
+    for (; it != end; ++it) {
+      ShmSegment * const seg = *it;
+      if (seg->size != size)
+        continue;
+      ++count;
+      if (!oldest || seg->last_use < oldest->last_use)
+        oldest = seg;
+      if (!shmSegmentBusy(display, seg)
+          && (!idle || seg->last_use < idle->last_use))
+        idle = seg;
     }
 
-    shm_attached = true;
-    image->data = shm_addr;
+    if (!idle) {
+      const size_t class_count = std::max(shm_class_limit / size, size_t(2u));
+      if (count < class_count) {
+        idle = createShmSegment(display, size);
+        if (idle)
+          shm_pool.push_back(idle);
+      }
+      if (!idle && oldest) {
+        // every segment in this class is in use, wait for the server
+#ifdef MITSHM_DEBUG
+        fprintf(stderr, "bt::findShmSegment: waiting for %lu byte segment\n",
+                static_cast<unsigned long>(size));
+#endif // MITSHM_DEBUG
+        XSync(display.XDisplay(), False);
+        idle = oldest;
+      }
+    }
+
+    if (idle)
+      idle->last_use = ++shm_clock;
+    return idle;
+  }
+
+
+  void destroyShmImage(const Display &display, XImage *image) {
+    // return the segment to the pool.  it is busy until the server
+    // has processed the last request sent (normally XShmPutImage)
+    ShmSegment * const seg = reinterpret_cast<ShmSegment *>(image->obdata);
+    if (seg)
+      seg->serial = NextRequest(display.XDisplay()) - 1;
+
+    // destroy XImage
+    image->data = 0;
+    image->obdata = 0;
+    XDestroyImage(image);
+  }
+
+
+  XImage *createShmImage(const Display &display, const ScreenInfo &screeninfo,
+                         unsigned int width, unsigned int height) {
+    if (!use_shm)
+      return 0;
+
+    // use MIT-SHM extension
+    XImage *image = XShmCreateImage(display.XDisplay(), screeninfo.visual(),
+                                    screeninfo.depth(), ZPixmap, 0,
+                                    0, width, height);
+    if (!image)
+      return 0;
+
+    const size_t usage = image->bytes_per_line * image->height;
+    ShmSegment *seg = 0;
+    if (usage <= shm_max_size)
+      seg = findShmSegment(display, usage);
+    if (!seg) {
+      // too large, or we failed to get a segment
+      image->obdata = 0;
+      XDestroyImage(image);
+      return 0;
+    }
+
+    image->obdata = reinterpret_cast<char *>(&seg->info);
+    image->data = seg->info.shmaddr;
     return image;
   }
 #endif // MITSHM
 
+#ifdef    XRENDER
+  static bool use_render = false;
+
+
+  void startupRender(const Display &display) {
+    // gradient pictures were added in RENDER 0.10
+    int event_base, error_base, major, minor;
+    if (!XRenderQueryExtension(display.XDisplay(), &event_base, &error_base)
+        || !XRenderQueryVersion(display.XDisplay(), &major, &minor))
+      return;
+    use_render = (major > 0 || minor >= 10);
+  }
+#endif // XRENDER
+
 } // namespace bt
 
 
 bt::XColorTable::XColorTable(const Display &dpy, unsigned int screen,
                              unsigned int maxColors)
-  : _dpy(dpy), _screen(screen),
+  : _dpy(&dpy), _screen(screen),
     n_red(0u), n_green(0u), n_blue(0u),
     red_shift(0u), green_shift(0u), blue_shift(0u)
 {
-  const ScreenInfo &screeninfo = _dpy.screenInfo(_screen);
+  const ScreenInfo &screeninfo = _dpy->screenInfo(_screen);
   const Visual * const visual = screeninfo.visual();
   const Colormap colormap = screeninfo.colormap();
 
@@ -309,7 +556,7 @@ bt::XColorTable::XColorTable(const Display &dpy, unsigned int screen,
           xcolor.blue  = gray;
           xcolor.pixel = 0ul;
 
-          if (XAllocColor(_dpy.XDisplay(), colormap, &xcolor))
+          if (XAllocColor(_dpy->XDisplay(), colormap, &xcolor))
             colors[g] = xcolor.pixel;
           else
             query_colormap = true;
@@ -382,7 +629,7 @@ bt::XColorTable::XColorTable(const Display &dpy, unsigned int screen,
               xcolor.blue  = (b * 0xffff + b_round) / b_max;
               xcolor.pixel = 0ul;
 
-              if (XAllocColor(_dpy.XDisplay(), colormap, &xcolor))
+              if (XAllocColor(_dpy->XDisplay(), colormap, &xcolor))
                 colors[x] = xcolor.pixel;
               else
                 query_colormap = true;
@@ -409,6 +656,8 @@ bt::XColorTable::XColorTable(const Display &dpy, unsigned int screen,
     break;
   } // switch
 
+  createTables();
+
 #ifdef COLORTABLE_DEBUG
   switch (visual_class) {
   case StaticGray:
@@ -448,14 +697,14 @@ bt::XColorTable::XColorTable(const Display &dpy, unsigned int screen,
   XColor queried[256];
   for (int x = 0; x < q_colors; ++x)
     queried[x].pixel = x;
-  XQueryColors(_dpy.XDisplay(), colormap, queried, q_colors);
+  XQueryColors(_dpy->XDisplay(), colormap, queried, q_colors);
 
 #ifdef COLORTABLE_DEBUG
   for (int x = 0; x < q_colors; ++x) {
     if (queried[x].red == 0
         && queried[x].green == 0
         && queried[x].blue == 0
-        && queried[x].pixel != BlackPixel(_dpy.XDisplay(), _screen)) {
+        && queried[x].pixel != BlackPixel(_dpy->XDisplay(), _screen)) {
       q_colors = x;
       break;
     }
@@ -516,12 +765,12 @@ bt::XColorTable::XColorTable(const Display &dpy, unsigned int screen,
     if (visual_class & 1) {
       XColor xcolor = queried[best];
 
-      if (XAllocColor(_dpy.XDisplay(), colormap, &xcolor)) {
+      if (XAllocColor(_dpy->XDisplay(), colormap, &xcolor)) {
         colors[x] = xcolor.pixel;
       } else {
         colors[x] = gray < SHRT_MAX
-                    ? BlackPixel(_dpy.XDisplay(), _screen)
-                    : WhitePixel(_dpy.XDisplay(), _screen);
+                    ? BlackPixel(_dpy->XDisplay(), _screen)
+                    : WhitePixel(_dpy->XDisplay(), _screen);
       }
     } else {
       colors[x] = best;
@@ -530,9 +779,55 @@ bt::XColorTable::XColorTable(const Display &dpy, unsigned int screen,
 }
 
 
+bt::XColorTable::XColorTable(const ImageFormat &format)
+  : _dpy(0), _screen(0u), visual_class(TrueColor)
+{
+  n_red   = right_align(format.red_mask)   + 1;
+  n_green = right_align(format.green_mask) + 1;
+  n_blue  = right_align(format.blue_mask)  + 1;
+
+  red_shift = lowest_bit(format.red_mask);
+  green_shift = lowest_bit(format.green_mask);
+  blue_shift = lowest_bit(format.blue_mask);
+
+  createTables();
+}
+
+
+void bt::XColorTable::createTables(void) {
+  for (unsigned int x = 0; x < 256u; ++x) {
+    unsigned int r = x, g = x, b = x;
+    map(r, g, b);
+
+    switch (visual_class) {
+    case StaticGray:
+    case GrayScale:
+      red_table[x]   = r * 30;
+      green_table[x] = g * 59;
+      blue_table[x]  = b * 11;
+      break;
+
+    case StaticColor:
+    case PseudoColor:
+      red_table[x]   = r * n_green * n_blue;
+      green_table[x] = g * n_blue;
+      blue_table[x]  = b;
+      break;
+
+    case TrueColor:
+    case DirectColor:
+      red_table[x]   = r << red_shift;
+      green_table[x] = g << green_shift;
+      blue_table[x]  = b << blue_shift;
+      break;
+    }
+  }
+}
+
+
 bt::XColorTable::~XColorTable(void) {
   if (!colors.empty()) {
-    XFreeColors(_dpy.XDisplay(), _dpy.screenInfo(_screen).colormap(),
+    XFreeColors(_dpy->XDisplay(), _dpy->screenInfo(_screen).colormap(),
                 &colors[0], colors.size(), 0);
     colors.clear();
   }
@@ -572,6 +867,106 @@ unsigned long bt::XColorTable::pixel(unsigned int red,
 }
 
 
+/*
+ * Row packers
+ *
+ * One packer is instantiated for every combination of pixel size, byte
+ * order and pixel lookup, so that the inner loop has no switches left
+ * in it.
+ */
+namespace bt {
+
+  template <unsigned int bytes, bool msb>
+  struct PixelWriter {
+    static inline void put(unsigned char *&pixel_data, unsigned long pixel) {
+      for (unsigned int i = 0; i < bytes; ++i)
+        pixel_data[i] = pixel >> ((msb ? bytes - 1 - i : i) * 8);
+      pixel_data += bytes;
+    }
+  };
+
+
+  template <class Writer, class Lookup>
+  static void packRow(const XColorTable &colortable,
+                      const RGB *row, unsigned int width,
+                      unsigned char *pixel_data) {
+    const Lookup lookup(colortable);
+    for (unsigned int x = 0; x < width; ++x)
+      Writer::put(pixel_data,
+                  lookup(row[x].red, row[x].green, row[x].blue));
+  }
+
+
+  // formats we do not know how to write are left untouched
+  static void packNothing(const XColorTable &, const RGB *, unsigned int,
+                          unsigned char *)
+  { }
+
+
+  template <class Lookup>
+  static XColorTable::RowPacker selectPacker(unsigned int bit_depth) {
+    switch (bit_depth) {
+    case  8: //  8bpp
+    case  9:
+      return packRow<PixelWriter<1, false>, Lookup>;
+    case 16: // 16bpp LSB
+      return packRow<PixelWriter<2, false>, Lookup>;
+    case 17: // 16bpp MSB
+      return packRow<PixelWriter<2, true>, Lookup>;
+    case 24: // 24bpp LSB
+      return packRow<PixelWriter<3, false>, Lookup>;
+    case 25: // 24bpp MSB
+      return packRow<PixelWriter<3, true>, Lookup>;
+    case 32: // 32bpp LSB
+      return packRow<PixelWriter<4, false>, Lookup>;
+    case 33: // 32bpp MSB
+      return packRow<PixelWriter<4, true>, Lookup>;
+    }
+    return packNothing;
+  }
+
+} // namespace bt
+
+
+bt::XColorTable::RowPacker
+bt::XColorTable::packer(unsigned int bit_depth, bool dithered) const {
+  switch (visual_class) {
+  case StaticGray:
+  case GrayScale:
+    return (dithered
+            ? selectPacker<GrayPixel>(bit_depth)
+            : selectPacker<GrayMap>(bit_depth));
+
+  case StaticColor:
+  case PseudoColor:
+    return (dithered
+            ? selectPacker<ColorCubePixel>(bit_depth)
+            : selectPacker<ColorCubeMap>(bit_depth));
+
+  case TrueColor:
+  case DirectColor:
+    if (dithered)
+      return selectPacker<TrueColorPixel>(bit_depth);
+    if (n_red == 256u && n_green == 256u && n_blue == 256u
+        && red_shift == 16 && green_shift == 8 && blue_shift == 0)
+      return selectPacker<RGB888Pixel>(bit_depth);
+    return selectPacker<TrueColorMap>(bit_depth);
+  }
+
+  // not reached
+  return packNothing;
+}
+
+
+bt::ImageFormat::ImageFormat(void)
+  : bits_per_pixel(32u), red_mask(0xff0000ul), green_mask(0x00ff00ul),
+    blue_mask(0x0000fful), bytes_per_line(0u)
+{
+  const unsigned int one = 1u;
+  msb_first = *reinterpret_cast<const unsigned char *>(&one) == 0;
+}
+
+
 bt::Image::Image(unsigned int w, unsigned int h)
   : data(0), width(w), height(h)
 {
@@ -586,8 +981,272 @@ bt::Image::~Image(void) {
 }
 
 
+namespace bt {
+
+  static XColorTable *colorTable(const Display &display, unsigned int screen) {
+    // get the colortable for the screen. if necessary, we will create one.
+    if (colorTableList.empty())
+      colorTableList.resize(display.screenCount(), 0);
+
+    if (!colorTableList[screen])
+      colorTableList[screen] =
+        new XColorTable(display, screen, Image::maximumColors());
+
+    return colorTableList[screen];
+  }
+
+
+  // the gradient rendered for a texture that has several types set
+  static unsigned long gradientType(unsigned long texture) {
+    static const unsigned long types[] = {
+      Texture::Diagonal,
+      Texture::Elliptic,
+      Texture::Horizontal,
+      Texture::Pyramid,
+      Texture::Rectangle,
+      Texture::Vertical,
+      Texture::CrossDiagonal,
+      Texture::PipeCross,
+      Texture::SplitVertical
+    };
+    for (unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+      if (texture & types[i])
+        return types[i];
+    }
+    return 0ul;
+  }
+
+
+  bool gradientGeometry(unsigned long texture,
+                        unsigned int width, unsigned int height,
+                        GradientGeometry &geometry) {
+    if (texture & Texture::Interlaced)
+      return false;
+
+    const unsigned long type = gradientType(texture);
+    const double w = width, h = height;
+    geometry.radial = false;
+    geometry.x1 = geometry.y1 = geometry.x2 = geometry.y2 = 0.0;
+    geometry.radius = 0.0;
+    geometry.y_scale = 1.0;
+
+    switch (type) {
+    case Texture::Horizontal:
+    case Texture::Vertical:
+    case Texture::Diagonal:
+    case Texture::CrossDiagonal: {
+      // from + (to - from) * (a . p + c), expressed as a line from p1
+      // to p2 where the projection of a pixel is (p - p1) . (p2 - p1)
+      // / |p2 - p1|^2
+      double ax = 0.0, ay = 0.0, x1 = 0.0;
+      if (type == Texture::Horizontal) {
+        ax = 1.0 / w;
+      } else if (type == Texture::Vertical) {
+        ay = 1.0 / h;
+      } else {
+        ax = 1.0 / (2.0 * w);
+        ay = 1.0 / (2.0 * h);
+        if (type == Texture::CrossDiagonal) {
+          ax = -ax;
+          x1 = w - 1.0;
+        }
+      }
+      const double len = (ax * ax) + (ay * ay);
+
+      // Image computes pixels at their top left corner, RENDER at
+      // their center
+      geometry.x1 = x1 + 0.5;
+      geometry.y1 = 0.5;
+      geometry.x2 = geometry.x1 + (ax / len);
+      geometry.y2 = geometry.y1 + (ay / len);
+      return true;
+    }
+
+    case Texture::Elliptic:
+      // to - (to - from) * r, where r is the distance from the center
+      // with both axes scaled to 1.  the y axis is stretched to the
+      // width.
+      geometry.radial = true;
+      geometry.radius = w;
+      geometry.y_scale = w / h;
+      geometry.x1 = (w / 2.0) + 0.5;
+      geometry.y1 = (w / 2.0) + (0.5 * geometry.y_scale);
+      return true;
+
+    default:
+      break;
+    }
+    return false;
+  }
+
+
+  /*
+   * Copies count rows (or columns, when vertical is true) starting at
+   * from in src to to in dst.  length is the width of a row (or the
+   * height of a column).
+   */
+  static void copySpan(const Pen &pen, Drawable src, Drawable dst,
+                       bool vertical, unsigned int from, unsigned int count,
+                       unsigned int to, unsigned int length) {
+    if (vertical)
+      XCopyArea(pen.XDisplay(), src, dst, pen.gc(),
+                from, 0, count, length, to, 0);
+    else
+      XCopyArea(pen.XDisplay(), src, dst, pen.gc(),
+                0, from, length, count, 0, to);
+  }
+
+
+
+#ifdef    XRENDER
+  /*
+   * RENDER backend
+   *
+   * Gradients that RENDER can express are drawn by the server directly
+   * into the pixmap, which saves computing and uploading the image.
+   * The results match the client side rendering to within a couple of
+   * steps per channel (tests/render-test checks this without a
+   * server).  Everything else (including bevels that do not fit,
+   * interlacing and dithering) is left to the client side code.
+   */
+  static XFixed fixed(double d)
+  { return XDoubleToFixed(d); }
+
+
+  static Picture createGradientPicture(::Display *dpy,
+                                       const GradientGeometry &geometry,
+                                       const Color &from, const Color &to) {
+    XRenderColor colors[2];
+    colors[0].red   = from.red()   * 0x101;
+    colors[0].green = from.green() * 0x101;
+    colors[0].blue  = from.blue()  * 0x101;
+    colors[0].alpha = 0xffff;
+    colors[1].red   = to.red()   * 0x101;
+    colors[1].green = to.green() * 0x101;
+    colors[1].blue  = to.blue()  * 0x101;
+    colors[1].alpha = 0xffff;
+    XFixed stops[2] = { fixed(0.0), fixed(1.0) };
+
+    Picture picture = None;
+    if (!geometry.radial) {
+      XLinearGradient gradient;
+      gradient.p1.x = fixed(geometry.x1);
+      gradient.p1.y = fixed(geometry.y1);
+      gradient.p2.x = fixed(geometry.x2);
+      gradient.p2.y = fixed(geometry.y2);
+      picture = XRenderCreateLinearGradient(dpy, &gradient, stops, colors, 2);
+    } else {
+      // t runs from the center outwards, from color2 to color1
+      XRadialGradient gradient;
+      gradient.inner.x = gradient.outer.x = fixed(geometry.x1);
+      gradient.inner.y = gradient.outer.y = fixed(geometry.y1);
+      gradient.inner.radius = fixed(0.0);
+      gradient.outer.radius = fixed(geometry.radius);
+      std::swap(colors[0], colors[1]);
+      picture = XRenderCreateRadialGradient(dpy, &gradient, stops, colors, 2);
+      if (picture) {
+        XTransform transform = {{
+          { fixed(1.0), fixed(0.0),              fixed(0.0) },
+          { fixed(0.0), fixed(geometry.y_scale), fixed(0.0) },
+          { fixed(0.0), fixed(0.0),              fixed(1.0) }
+        }};
+        XRenderSetPictureTransform(dpy, picture, &transform);
+      }
+    }
+
+    if (picture) {
+      XRenderPictureAttributes attrs;
+      attrs.repeat = RepeatPad;
+      XRenderChangePicture(dpy, picture, CPRepeat, &attrs);
+    }
+    return picture;
+  }
+
+
+  // lightens or darkens the specified area like lightenRow() and
+  // darkenRow() do on the client side
+  static void renderShade(::Display *dpy, Picture picture, bool lighten,
+                          int x, int y, unsigned int w, unsigned int h) {
+    if (lighten) {
+      // p + p / 2
+      const XRenderColor half = { 0, 0, 0, 0x8000 };
+      Picture mask = XRenderCreateSolidFill(dpy, &half);
+      XRenderComposite(dpy, PictOpAdd, picture, mask, picture,
+                       x, y, 0, 0, x, y, w, h);
+      XRenderFreePicture(dpy, mask);
+    } else {
+      // p * 3 / 4
+      const XRenderColor quarter = { 0, 0, 0, 0x4000 };
+      XRenderFillRectangle(dpy, PictOpOver, picture, &quarter, x, y, w, h);
+    }
+  }
+
+
+  static Pixmap renderWithXRender(const Display &display, unsigned int screen,
+                                  const Texture &texture,
+                                  unsigned int width, unsigned int height) {
+    if (!use_render)
+      return None;
+
+    GradientGeometry geometry;
+    if (!gradientGeometry(texture.texture(), width, height, geometry))
+      return None;
+
+    const ScreenInfo &screeninfo = display.screenInfo(screen);
+    if (screeninfo.visual()->c_class != TrueColor
+        || colorTable(display, screen)->ditherMode() != NoDither)
+      return None;
+
+    ::Display * const dpy = display.XDisplay();
+    XRenderPictFormat *format =
+      XRenderFindVisualFormat(dpy, screeninfo.visual());
+    if (!format)
+      return None;
+
+    Picture gradient = createGradientPicture(dpy, geometry,
+                                             texture.color1(),
+                                             texture.color2());
+    if (!gradient)
+      return None;
+
+    Pixmap pixmap = XCreatePixmap(dpy, screeninfo.rootWindow(),
+                                  width, height, screeninfo.depth());
+    if (!pixmap) {
+      XRenderFreePicture(dpy, gradient);
+      return None;
+    }
+
+    Picture picture = XRenderCreatePicture(dpy, pixmap, format, 0, 0);
+    XRenderComposite(dpy, PictOpSrc, gradient, None, picture,
+                     0, 0, 0, 0, 0, 0, width, height);
+    XRenderFreePicture(dpy, gradient);
+
+    // same geometry as Image::bevel(), raisedBevel() and sunkenBevel()
+    const unsigned int bw = texture.borderWidth();
+    const bool raised = texture.texture() & Texture::Raised;
+    if ((raised || (texture.texture() & Texture::Sunken))
+        && !(width <= 2 || height <= 2 ||
+             width <= (bw * 4) || height <= (bw * 4))) {
+      const unsigned int w = width - (bw * 2);
+      const unsigned int h = height - (bw * 2) - 2;
+
+      renderShade(dpy, picture, raised, bw, bw, w, 1);
+      renderShade(dpy, picture, raised, bw, bw + 1, 1, h);
+      renderShade(dpy, picture, !raised, bw + w - 1, bw + 1, 1, h);
+      renderShade(dpy, picture, !raised, bw, bw + h + 1, w, 1);
+    }
+
+    XRenderFreePicture(dpy, picture);
+    return pixmap;
+  }
+#endif // XRENDER
+
+} // namespace bt
+
+
 Pixmap bt::Image::render(const Display &display, unsigned int screen,
                          const bt::Texture &texture) {
+  TraceSpan span("Image::render");
   if (texture.texture() & bt::Texture::Parent_Relative)
     return ParentRelative;
   if (texture.texture() & bt::Texture::Solid)
@@ -595,49 +1254,208 @@ Pixmap bt::Image::render(const Display &display, unsigned int screen,
   if (!(texture.texture() & bt::Texture::Gradient))
     return None;
 
-  const Color from = texture.color1(), to = texture.color2();
-  const bool interlaced = texture.texture() & bt::Texture::Interlaced;
+  Pixmap pixmap = None;
+
+#ifdef    XRENDER
+  pixmap = renderWithXRender(display, screen, texture, width, height);
+#endif // XRENDER
+
+  /*
+    Horizontal gradients only change along the x axis, and vertical
+    gradients only along the y axis.  Apart from the bevel and border,
+    every row (or column) of such an image is the same, so we render a
+    strip that holds one of each distinct row (or column) and let the
+    server expand it.  The ordered and Floyd-Steinberg dithers depend
+    on both coordinates, as does the interlacing of horizontal
+    gradients, so those are rendered in full.
+  */
+  const unsigned long type = gradientType(texture.texture());
+  const unsigned int strip = (texture.borderWidth() * 2) + 3;
+  if (!pixmap && colorTable(display, screen)->ditherMode() == bt::NoDither) {
+    if (type == bt::Texture::Horizontal && height > strip
+        && !(texture.texture() & bt::Texture::Interlaced))
+      pixmap = renderStrip(display, screen, texture, false);
+    else if ((type == bt::Texture::Vertical
+              || type == bt::Texture::SplitVertical) && width > strip)
+      pixmap = renderStrip(display, screen, texture, true);
+  }
+
+  if (!pixmap) {
+    data = new RGB[width * height];
+    gradient(texture);
+    bevel(texture, width, height);
+    pixmap = renderPixmap(display, screen);
+  }
+
+  unsigned int bw = 0;
+  if (pixmap && (texture.texture() & bt::Texture::Border)) {
+    Pen penborder(screen, texture.borderColor());
+    bw = texture.borderWidth();
 
+    for (unsigned int i = 0; i < bw; ++i) {
+      XDrawRectangle(penborder.XDisplay(), pixmap, penborder.gc(),
+                     i, i, width - (i * 2) - 1, height - (i * 2) - 1);
+    }
+  }
+
+  return pixmap;
+}
+
+
+bool bt::Image::render(const Texture &texture, const ImageFormat &format,
+                       unsigned char *pixel_data) {
+  if (!(texture.texture() & bt::Texture::Gradient)
+      || (texture.texture() & (bt::Texture::Parent_Relative
+                               | bt::Texture::Solid)))
+    return false;
+
+  switch (format.bits_per_pixel) {
+  case 8: case 16: case 24: case 32:
+    break;
+  default:
+    return false;
+  }
+  if (!format.red_mask || !format.green_mask || !format.blue_mask)
+    return false;
+
+  const unsigned int bytes_per_line =
+    std::max(format.bytes_per_line, width * (format.bits_per_pixel / 8));
+
+  delete [] data;
   data = new RGB[width * height];
+  gradient(texture);
+  bevel(texture, width, height);
+  border(texture);
+
+  XColorTable colortable(format);
+  renderPixels(&colortable, format.bits_per_pixel, format.msb_first,
+               bytes_per_line, pixel_data);
+  return true;
+}
+
+
+Pixmap bt::Image::renderStrip(const Display &display, unsigned int screen,
+                              const Texture &texture, bool vertical) {
+  // the strip holds the rows (or columns) outside the bevel, the two
+  // bevel edges and a single row (or column) of the middle
+  const unsigned int bw = texture.borderWidth();
+  const unsigned int length = vertical ? height : width;
+  const unsigned int total = vertical ? width : height;
+
+  Image image(vertical ? (bw * 2) + 3 : width,
+              vertical ? height : (bw * 2) + 3);
+  image.data = new RGB[image.width * image.height];
+  image.gradient(texture);
+  image.bevel(texture, width, height);
+
+  const Pixmap stripmap = image.renderPixmap(display, screen);
+  if (!stripmap)
+    return None;
+
+  const ScreenInfo &screeninfo = display.screenInfo(screen);
+  Pixmap pixmap = XCreatePixmap(display.XDisplay(), screeninfo.rootWindow(),
+                                width, height, screeninfo.depth());
+  if (pixmap) {
+    Pen pen(screen, Color(0, 0, 0));
+
+    // leading edge and the first middle row
+    copySpan(pen, stripmap, pixmap, vertical, 0, bw + 2, 0, length);
+
+    // the remaining middle rows, doubling the copied area each time
+    const unsigned int first = bw + 1, count = total - (bw * 2) - 2;
+    for (unsigned int done = 1; done < count; ) {
+      const unsigned int n = std::min(done, count - done);
+      copySpan(pen, pixmap, pixmap, vertical, first, n, first + done, length);
+      done += n;
+    }
+
+    // trailing edge
+    copySpan(pen, stripmap, pixmap, vertical,
+             bw + 2, bw + 1, total - bw - 1, length);
+  }
 
-  if (texture.texture() & bt::Texture::Diagonal)
+  XFreePixmap(display.XDisplay(), stripmap);
+  return pixmap;
+}
+
+
+void bt::Image::gradient(const Texture &texture) {
+  const Color from = texture.color1(), to = texture.color2();
+  const bool interlaced = texture.texture() & bt::Texture::Interlaced;
+
+  switch (gradientType(texture.texture())) {
+  case bt::Texture::Diagonal:
     dgradient(from, to, interlaced);
-  else if (texture.texture() & bt::Texture::Elliptic)
+    break;
+  case bt::Texture::Elliptic:
     egradient(from, to, interlaced);
-  else if (texture.texture() & bt::Texture::Horizontal)
+    break;
+  case bt::Texture::Horizontal:
     hgradient(from, to, interlaced);
-  else if (texture.texture() & bt::Texture::Pyramid)
+    break;
+  case bt::Texture::Pyramid:
     pgradient(from, to, interlaced);
-  else if (texture.texture() & bt::Texture::Rectangle)
+    break;
+  case bt::Texture::Rectangle:
     rgradient(from, to, interlaced);
-  else if (texture.texture() & bt::Texture::Vertical)
+    break;
+  case bt::Texture::Vertical:
     partial_vgradient(from, to, interlaced, 0, height);
-  else if (texture.texture() & bt::Texture::CrossDiagonal)
+    break;
+  case bt::Texture::CrossDiagonal:
     cdgradient(from, to, interlaced);
-  else if (texture.texture() & bt::Texture::PipeCross)
+    break;
+  case bt::Texture::PipeCross:
     pcgradient(from, to, interlaced);
-  else if (texture.texture() & bt::Texture::SplitVertical)
+    break;
+  case bt::Texture::SplitVertical:
     svgradient(from, to, interlaced);
+    break;
+  }
+}
 
-  if (texture.texture() & bt::Texture::Raised)
-    raisedBevel(texture.borderWidth());
-  else if (texture.texture() & bt::Texture::Sunken)
-    sunkenBevel(texture.borderWidth());
-
-  Pixmap pixmap = renderPixmap(display, screen);
 
-  unsigned int bw = 0;
-  if (texture.texture() & bt::Texture::Border) {
-    Pen penborder(screen, texture.borderColor());
-    bw = texture.borderWidth();
+// the same rectangles that render() draws on the pixmap
+void bt::Image::border(const Texture &texture) {
+  if (!(texture.texture() & bt::Texture::Border))
+    return;
 
-    for (unsigned int i = 0; i < bw; ++i) {
-      XDrawRectangle(penborder.XDisplay(), pixmap, penborder.gc(),
-                     i, i, width - (i * 2) - 1, height - (i * 2) - 1);
+  const Color &color = texture.borderColor();
+  RGB pen;
+  pen.red = color.red();
+  pen.green = color.green();
+  pen.blue = color.blue();
+  pen.reserved = 0;
+
+  const unsigned int bw = texture.borderWidth();
+  for (unsigned int i = 0; i < bw && i * 2 < width && i * 2 < height; ++i) {
+    RGB * const top = data + (i * width), * const bottom =
+      data + ((height - i - 1) * width);
+    std::fill(top + i, top + width - i, pen);
+    std::fill(bottom + i, bottom + width - i, pen);
+    for (unsigned int y = i + 1; y < height - i - 1; ++y) {
+      data[(y * width) + i] = pen;
+      data[(y * width) + width - i - 1] = pen;
     }
   }
+}
 
-  return pixmap;
+
+/*
+ * The bevel is only drawn if it fits into an image of the specified
+ * size, which is larger than this image when rendering a strip.
+ */
+void bt::Image::bevel(const Texture &texture,
+                      unsigned int full_width, unsigned int full_height) {
+  const unsigned int bw = texture.borderWidth();
+  if (full_width <= 2 || full_height <= 2 ||
+      full_width <= (bw * 4) || full_height <= (bw * 4))
+    return;
+
+  if (texture.texture() & bt::Texture::Raised)
+    raisedBevel(bw);
+  else if (texture.texture() & bt::Texture::Sunken)
+    sunkenBevel(bw);
 }
 
 
@@ -680,97 +1498,109 @@ static const unsigned int dither16[16][16] = {
 };
 
 
-/*
- * Helper function for TrueColorDither and renderXImage
- *
- * This handles the proper setting of the image data based on the image depth
- * and the machine's byte ordering
- */
-static void assignPixelData(unsigned int bit_depth, unsigned char **data,
-                            unsigned long pixel) {
-  unsigned char *pixel_data = *data;
-  switch (bit_depth) {
-  case  8: //  8bpp
-    pixel_data[0] = pixel;
-    ++pixel_data;
-    break;
+namespace bt {
 
-  case 16: // 16bpp LSB
-    pixel_data[0] = pixel;
-    pixel_data[1] = pixel >> 8;
-    pixel_data += 2;
-    break;
+  /*
+   * Large images are rendered, dithered and packed in bands of rows on
+   * the worker threads.  Bands are kept above a minimum size, so small
+   * images are not worth the hand-off and stay on the calling thread.
+   */
+  static unsigned int bandRows(unsigned int width)
+  { return std::max(32768u / width, 1u); }
 
-  case 17: // 16bpp MSB
-    pixel_data[0] = pixel >> 8;
-    pixel_data[1] = pixel;
-    pixel_data += 2;
-    break;
 
-  case 24: // 24bpp LSB
-    pixel_data[0] = pixel;
-    pixel_data[1] = pixel >> 8;
-    pixel_data[2] = pixel >> 16;
-    pixel_data += 3;
-    break;
+  // packs rows [begin, end) of an undithered image
+  class PackJob : public ParallelJob {
+  public:
+    PackJob(const XColorTable &colortable, XColorTable::RowPacker pack,
+            const RGB *data, unsigned int width,
+            unsigned int bytes_per_line, unsigned char *pixel_data)
+      : _colortable(colortable), _pack(pack), _data(data), _width(width),
+        _bytes_per_line(bytes_per_line), _pixel_data(pixel_data)
+    { }
+
+    void run(unsigned int begin, unsigned int end) {
+      const RGB *row = _data + (begin * _width);
+      unsigned char *pixel_data = _pixel_data + (begin * _bytes_per_line);
+      for (unsigned int y = begin; y < end; ++y) {
+        _pack(_colortable, row, _width, pixel_data);
+        row += _width;
+        pixel_data += _bytes_per_line;
+      }
+    }
 
-  case 25: // 24bpp MSB
-    pixel_data[0] = pixel >> 16;
-    pixel_data[1] = pixel >> 8;
-    pixel_data[2] = pixel;
-    pixel_data += 3;
-    break;
+  private:
+    const XColorTable &_colortable;
+    XColorTable::RowPacker _pack;
+    const RGB *_data;
+    unsigned int _width, _bytes_per_line;
+    unsigned char *_pixel_data;
+  };
 
-  case 32: // 32bpp LSB
-    pixel_data[0] = pixel;
-    pixel_data[1] = pixel >> 8;
-    pixel_data[2] = pixel >> 16;
-    pixel_data[3] = pixel >> 24;
-    pixel_data += 4;
-    break;
 
-  case 33: // 32bpp MSB
-    pixel_data[0] = pixel >> 24;
-    pixel_data[1] = pixel >> 16;
-    pixel_data[2] = pixel >> 8;
-    pixel_data[3] = pixel;
-    pixel_data += 4;
-    break;
-  }
-  *data = pixel_data; // assign back so we don't lose our place
-}
+  // algorithm: ordered dithering... many many thanks to rasterman
+  // (raster@rasterman.com) for telling me about this... portions of this
+  // code is based off of his code in Imlib
+  class OrderedDitherJob : public ParallelJob {
+  public:
+    OrderedDitherJob(XColorTable &colortable, XColorTable::RowPacker pack,
+                     const RGB *data, unsigned int width,
+                     unsigned int bytes_per_line, unsigned char *pixel_data)
+      : _colortable(colortable), _pack(pack), _data(data), _width(width),
+        _bytes_per_line(bytes_per_line), _pixel_data(pixel_data)
+    {
+      unsigned int maxr = 255, maxg = 255, maxb = 255;
+      colortable.map(maxr, maxg, maxb);
+      _mr = 256 * maxr + maxr + 1;
+      _mg = 256 * maxg + maxg + 1;
+      _mb = 256 * maxb + maxb + 1;
+    }
 
+    void run(unsigned int begin, unsigned int end) {
+      unsigned int x, y, dithx, dithy, error;
+      unsigned int offset = begin * _width;
+      unsigned char *pixel_data = _pixel_data + (begin * _bytes_per_line);
+      RGB *pixels = new RGB[_width];
 
-// algorithm: ordered dithering... many many thanks to rasterman
-// (raster@rasterman.com) for telling me about this... portions of this
-// code is based off of his code in Imlib
-void bt::Image::OrderedDither(XColorTable *colortable,
-                              unsigned int bit_depth,
-                              unsigned int bytes_per_line,
-                              unsigned char *pixel_data) {
-  unsigned int x, y, dithx, dithy, r, g, b, error, offset;
-  unsigned char *ppixel_data = pixel_data;
-
-  unsigned int maxr = 255, maxg = 255, maxb = 255;
-  colortable->map(maxr, maxg, maxb);
+      for (y = begin; y < end; ++y) {
+        dithy = y & 15;
 
-  for (y = 0, offset = 0; y < height; ++y) {
-    dithy = y & 15;
+        for (x = 0; x < _width; ++x, ++offset) {
+          dithx = x & 15;
 
-    for (x = 0; x < width; ++x, ++offset) {
-      dithx = x & 15;
+          error = dither16[dithy][dithx];
 
-      error = dither16[dithy][dithx];
+          pixels[x].red   = ((_mr * _data[offset].red   + error) / 65536);
+          pixels[x].green = ((_mg * _data[offset].green + error) / 65536);
+          pixels[x].blue  = ((_mb * _data[offset].blue  + error) / 65536);
+        }
 
-      r = (((256 * maxr + maxr + 1) * data[offset].red   + error) / 65536);
-      g = (((256 * maxg + maxg + 1) * data[offset].green + error) / 65536);
-      b = (((256 * maxb + maxb + 1) * data[offset].blue  + error) / 65536);
+        _pack(_colortable, pixels, _width, pixel_data);
+        pixel_data += _bytes_per_line;
+      }
 
-      assignPixelData(bit_depth, &pixel_data, colortable->pixel(r, g, b));
+      delete [] pixels;
     }
 
-    pixel_data = (ppixel_data += bytes_per_line);
-  }
+  private:
+    const XColorTable &_colortable;
+    XColorTable::RowPacker _pack;
+    const RGB *_data;
+    unsigned int _width, _bytes_per_line;
+    unsigned char *_pixel_data;
+    unsigned int _mr, _mg, _mb;
+  };
+
+} // namespace bt
+
+
+void bt::Image::OrderedDither(XColorTable *colortable,
+                              unsigned int bit_depth,
+                              unsigned int bytes_per_line,
+                              unsigned char *pixel_data) {
+  OrderedDitherJob job(*colortable, colortable->packer(bit_depth, true),
+                       data, width, bytes_per_line, pixel_data);
+  parallelFor(job, height, bandRows(width));
 }
 
 
@@ -788,7 +1618,7 @@ void bt::Image::FloydSteinbergDither(XColorTable *colortable,
 
   int rer, ger, ber;
   unsigned int x, y, r, g, b, offset;
-  unsigned char *ppixel_data = pixel_data;
+  const XColorTable::RowPacker pack = colortable->packer(bit_depth, true);
   RGB *pixels = new RGB[width];
 
   unsigned int maxr = 255, maxg = 255, maxb = 255;
@@ -862,338 +1692,694 @@ void bt::Image::FloydSteinbergDither(XColorTable *colortable,
         g = static_cast<unsigned int>(std::max(std::min(gl1[x], 255), 0));
         b = static_cast<unsigned int>(std::max(std::min(bl1[x], 255), 0));
 
-        colortable->map(r, g, b);
+        colortable->map(r, g, b);
+
+        pixels[x].red   = r;
+        pixels[x].green = g;
+        pixels[x].blue  = b;
+
+        rer = rl1[x] - static_cast<int>(r * maxr);
+        ger = gl1[x] - static_cast<int>(g * maxg);
+        ber = bl1[x] - static_cast<int>(b * maxb);
+
+        if (x > 0) {
+          rl1[x-1] += rer * 7 / 16;
+          gl1[x-1] += ger * 7 / 16;
+          bl1[x-1] += ber * 7 / 16;
+          rl2[x-1] += rer * 1 / 16;
+          gl2[x-1] += ger * 1 / 16;
+          bl2[x-1] += ber * 1 / 16;
+        }
+        rl2[x] += rer * 5 / 16;
+        gl2[x] += ger * 5 / 16;
+        bl2[x] += ber * 5 / 16;
+        if (x+1 < width) {
+          rl2[x+1] += rer * 3 / 16;
+          gl2[x+1] += ger * 3 / 16;
+          bl2[x+1] += ber * 3 / 16;
+        }
+      }
+    }
+    pack(*colortable, pixels, width, pixel_data);
+
+    offset += width;
+    pixel_data += bytes_per_line;
+  }
+
+  delete [] error;
+  delete [] pixels;
+}
+
+
+void bt::Image::renderPixels(XColorTable *colortable,
+                             unsigned int bits_per_pixel, bool msb_first,
+                             unsigned int bytes_per_line,
+                             unsigned char *pixel_data) {
+  const unsigned int o = bits_per_pixel + (msb_first ? 1 : 0);
+
+  DitherMode dmode =
+    (width > 1 && height > 1) ? colortable->ditherMode() : NoDither;
+
+  switch (dmode) {
+  case bt::FloydSteinbergDither:
+    FloydSteinbergDither(colortable, o, bytes_per_line, pixel_data);
+    break;
+
+  case bt::OrderedDither:
+    OrderedDither(colortable, o, bytes_per_line, pixel_data);
+    break;
+
+  case bt::NoDither: {
+    PackJob job(*colortable, colortable->packer(o, false),
+                data, width, bytes_per_line, pixel_data);
+    parallelFor(job, height, bandRows(width));
+    break;
+  }
+  } // switch dmode
+}
+
+
+Pixmap bt::Image::renderPixmap(const Display &display, unsigned int screen) {
+  XColorTable *colortable = colorTable(display, screen);
+  const ScreenInfo &screeninfo = display.screenInfo(screen);
+  XImage *image = 0;
+  bool shm_ok = false;
+
+#ifdef MITSHM
+  // try to use MIT-SHM extension
+  if (use_shm) {
+    image = createShmImage(display, screeninfo, width, height);
+    shm_ok = (image != 0);
+  }
+#endif // MITSHM
+
+  if (!shm_ok) {
+    // regular XImage
+    image = XCreateImage(display.XDisplay(), screeninfo.visual(),
+                         screeninfo.depth(), ZPixmap,
+                         0, 0, width, height, 32, 0);
+    if (!image)
+      return None;
+
+    buffer.reserve(image->bytes_per_line * (height + 1));
+    image->data = reinterpret_cast<char *>(&buffer[0]);
+  }
+
+  // render to XImage
+  renderPixels(colortable, image->bits_per_pixel,
+               image->byte_order == MSBFirst, image->bytes_per_line,
+               reinterpret_cast<unsigned char *>(image->data));
+
+  Pixmap pixmap = XCreatePixmap(display.XDisplay(), screeninfo.rootWindow(),
+                                width, height, screeninfo.depth());
+  if (pixmap == None) {
+#ifdef MITSHM
+    if (shm_ok)
+      destroyShmImage(display, image);
+    else
+#endif // MITSHM
+      {
+        image->data = 0;
+        XDestroyImage(image);
+      }
+
+    return None;
+  }
+
+  Pen pen(screen, Color(0, 0, 0));
+
+#ifdef MITSHM
+  if (shm_ok) {
+    // use MIT-SHM extension
+    XShmPutImage(pen.XDisplay(), pixmap, pen.gc(), image,
+                 0, 0, 0, 0, width, height, False);
+
+    destroyShmImage(display, image);
+  } else
+#endif // MITSHM
+    {
+      // normal XPutImage
+      XPutImage(pen.XDisplay(), pixmap, pen.gc(), image,
+                0, 0, 0, 0, width, height);
+
+      image->data = 0;
+      XDestroyImage(image);
+    }
+
+  return pixmap;
+}
+
+
+/*
+ * Gradient kernels
+ *
+ * The 2-dimensional gradients are built from one table per axis.
+ * Each row of the image combines the x table with a single entry of
+ * the y table.  All combining is done on 8-bit channels modulo 256
+ * (which is what assigning to the RGB bitfields does), so the SSE2
+ * and AVX2 kernels produce exactly the same pixels as the scalar
+ * kernels.
+ *
+ * The sum, max2 and min2 kernels compute
+ *
+ *   out = t + ((v ^ m) - m)
+ *
+ * where v is (xt + y), 2 * max(xt, y) or 2 * min(xt, y).  A channel
+ * mask m of 0xff negates v, which handles both t - v and t + v
+ * without branches.
+ */
+namespace bt {
+
+  typedef void (*CombineKernel)(RGB *out, const RGB *xt, RGB y,
+                                RGB t, RGB m, unsigned int n);
+  typedef void (*EllipticKernel)(RGB *out, unsigned int * const xt[3],
+                                 const unsigned int y[3],
+                                 RGB t, RGB m, unsigned int n);
+  typedef void (*RowKernel)(RGB *p, unsigned int n);
+
+  struct GradientKernels {
+    CombineKernel sum;
+    CombineKernel max2;
+    CombineKernel min2;
+    EllipticKernel elliptic;
+    RowKernel interlace; // p = (p >> 1) + (p >> 2)
+    RowKernel lighten;   // p = min(p + (p >> 1), 255)
+    RowKernel darken;    // p = (p >> 2) + (p >> 1)
+  };
+
+
+  static inline unsigned char *channels(RGB *p)
+  { return reinterpret_cast<unsigned char *>(p); }
+  static inline const unsigned char *channels(const RGB *p)
+  { return reinterpret_cast<const unsigned char *>(p); }
+
+
+  static void sumRow(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                     unsigned int n) {
+    unsigned char *o = channels(out);
+    const unsigned char *x = channels(xt), *yy = channels(&y),
+                        *tt = channels(&t), *mm = channels(&m);
+    for (unsigned int i = 0; i < n * 4; ++i) {
+      const unsigned char v = x[i] + yy[i & 3];
+      o[i] = tt[i & 3] + ((v ^ mm[i & 3]) - mm[i & 3]);
+    }
+  }
+
+
+  static void max2Row(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                      unsigned int n) {
+    unsigned char *o = channels(out);
+    const unsigned char *x = channels(xt), *yy = channels(&y),
+                        *tt = channels(&t), *mm = channels(&m);
+    for (unsigned int i = 0; i < n * 4; ++i) {
+      const unsigned char v = std::max(x[i], yy[i & 3]) * 2;
+      o[i] = tt[i & 3] + ((v ^ mm[i & 3]) - mm[i & 3]);
+    }
+  }
+
+
+  static void min2Row(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                      unsigned int n) {
+    unsigned char *o = channels(out);
+    const unsigned char *x = channels(xt), *yy = channels(&y),
+                        *tt = channels(&t), *mm = channels(&m);
+    for (unsigned int i = 0; i < n * 4; ++i) {
+      const unsigned char v = std::min(x[i], yy[i & 3]) * 2;
+      o[i] = tt[i & 3] + ((v ^ mm[i & 3]) - mm[i & 3]);
+    }
+  }
+
+
+  static void ellipticRow(RGB *out, unsigned int * const xt[3],
+                          const unsigned int y[3], RGB t, RGB m,
+                          unsigned int n) {
+    const unsigned int sr = m.red ? 1u : ~0u, sg = m.green ? 1u : ~0u,
+                       sb = m.blue ? 1u : ~0u;
+    for (unsigned int x = 0; x < n; ++x) {
+      const RGB rgb = {
+        static_cast<unsigned char>
+        (t.red   - (sr * static_cast<int>(sqrt(xt[0][x] + y[0])))),
+        static_cast<unsigned char>
+        (t.green - (sg * static_cast<int>(sqrt(xt[1][x] + y[1])))),
+        static_cast<unsigned char>
+        (t.blue  - (sb * static_cast<int>(sqrt(xt[2][x] + y[2])))),
+        0
+      };
+      out[x] = rgb;
+    }
+  }
+
+
+  static void interlaceRow(RGB *p, unsigned int n) {
+    unsigned char *o = channels(p);
+    for (unsigned int i = 0; i < n * 4; ++i)
+      o[i] = (o[i] >> 1) + (o[i] >> 2);
+  }
+
+
+  static void lightenRow(RGB *p, unsigned int n) {
+    unsigned char *o = channels(p);
+    for (unsigned int i = 0; i < n * 4; ++i) {
+      const unsigned int v = o[i] + (o[i] >> 1);
+      o[i] = (v > 0xff) ? 0xff : v;
+    }
+  }
+
+
+  static void darkenRow(RGB *p, unsigned int n) {
+    unsigned char *o = channels(p);
+    for (unsigned int i = 0; i < n * 4; ++i)
+      o[i] = (o[i] >> 2) + (o[i] >> 1);
+  }
+
+
+  static const GradientKernels scalar_kernels = {
+    sumRow, max2Row, min2Row, ellipticRow,
+    interlaceRow, lightenRow, darkenRow
+  };
+
+
+#ifdef BT_X86_SIMD
+  static inline int packRGB(RGB c) {
+    int ret;
+    memcpy(&ret, &c, sizeof(ret));
+    return ret;
+  }
 
-        pixels[x].red   = r;
-        pixels[x].green = g;
-        pixels[x].blue  = b;
 
-        rer = rl1[x] - static_cast<int>(r * maxr);
-        ger = gl1[x] - static_cast<int>(g * maxg);
-        ber = bl1[x] - static_cast<int>(b * maxb);
+  // bit offset of each channel inside a packed RGB
+  static int channelShift(unsigned int channel) {
+    RGB c = { 0, 0, 0, 0 };
+    switch (channel) {
+    case 0: c.red   = 0xff; break;
+    case 1: c.green = 0xff; break;
+    case 2: c.blue  = 0xff; break;
+    }
+    return lowest_bit(static_cast<unsigned int>(packRGB(c)));
+  }
 
-        if (x > 0) {
-          rl1[x-1] += rer * 7 / 16;
-          gl1[x-1] += ger * 7 / 16;
-          bl1[x-1] += ber * 7 / 16;
-          rl2[x-1] += rer * 1 / 16;
-          gl2[x-1] += ger * 1 / 16;
-          bl2[x-1] += ber * 1 / 16;
-        }
-        rl2[x] += rer * 5 / 16;
-        gl2[x] += ger * 5 / 16;
-        bl2[x] += ber * 5 / 16;
-        if (x+1 < width) {
-          rl2[x+1] += rer * 3 / 16;
-          gl2[x+1] += ger * 3 / 16;
-          bl2[x+1] += ber * 3 / 16;
-        }
-      }
+
+  __attribute__((target("sse2")))
+  static void sumRowSSE2(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                         unsigned int n) {
+    const __m128i vy = _mm_set1_epi32(packRGB(y));
+    const __m128i vt = _mm_set1_epi32(packRGB(t));
+    const __m128i vm = _mm_set1_epi32(packRGB(m));
+    unsigned int x = 0;
+    for (; x + 4 <= n; x += 4) {
+      __m128i v =
+        _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(xt + x)),
+                     vy);
+      v = _mm_sub_epi8(_mm_xor_si128(v, vm), vm);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x),
+                       _mm_add_epi8(vt, v));
     }
-    for (x = 0; x < width; ++x) {
-      r = pixels[x].red;
-      g = pixels[x].green;
-      b = pixels[x].blue;
-      assignPixelData(bit_depth, &pixel_data, colortable->pixel(r, g, b));
+    sumRow(out + x, xt + x, y, t, m, n - x);
+  }
+
+
+  __attribute__((target("sse2")))
+  static void max2RowSSE2(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                          unsigned int n) {
+    const __m128i vy = _mm_set1_epi32(packRGB(y));
+    const __m128i vt = _mm_set1_epi32(packRGB(t));
+    const __m128i vm = _mm_set1_epi32(packRGB(m));
+    unsigned int x = 0;
+    for (; x + 4 <= n; x += 4) {
+      __m128i v =
+        _mm_max_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(xt + x)),
+                     vy);
+      v = _mm_add_epi8(v, v);
+      v = _mm_sub_epi8(_mm_xor_si128(v, vm), vm);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x),
+                       _mm_add_epi8(vt, v));
     }
+    max2Row(out + x, xt + x, y, t, m, n - x);
+  }
 
-    offset += width;
-    pixel_data = (ppixel_data += bytes_per_line);
+
+  __attribute__((target("sse2")))
+  static void min2RowSSE2(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                          unsigned int n) {
+    const __m128i vy = _mm_set1_epi32(packRGB(y));
+    const __m128i vt = _mm_set1_epi32(packRGB(t));
+    const __m128i vm = _mm_set1_epi32(packRGB(m));
+    unsigned int x = 0;
+    for (; x + 4 <= n; x += 4) {
+      __m128i v =
+        _mm_min_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(xt + x)),
+                     vy);
+      v = _mm_add_epi8(v, v);
+      v = _mm_sub_epi8(_mm_xor_si128(v, vm), vm);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x),
+                       _mm_add_epi8(vt, v));
+    }
+    min2Row(out + x, xt + x, y, t, m, n - x);
   }
 
-  delete [] error;
-  delete [] pixels;
-}
 
+  /*
+    The sums of the elliptic tables are below 2^17, and for all
+    integers below 2^24 the truncated single precision square root is
+    the same as the truncated double precision square root.
+  */
+  __attribute__((target("sse2")))
+  static void ellipticRowSSE2(RGB *out, unsigned int * const xt[3],
+                              const unsigned int y[3], RGB t, RGB m,
+                              unsigned int n) {
+    const unsigned char *tt = channels(&t), *mm = channels(&m);
+    __m128i vy[3], vt[3], vm[3], vs[3];
+    for (unsigned int c = 0; c < 3; ++c) {
+      const int s = channelShift(c);
+      vy[c] = _mm_set1_epi32(y[c]);
+      vt[c] = _mm_set1_epi32(tt[s / 8]);
+      vm[c] = _mm_set1_epi32(mm[s / 8] ? -1 : 0);
+      vs[c] = _mm_cvtsi32_si128(s);
+    }
+    const __m128i mask = _mm_set1_epi32(0xff);
+    unsigned int x = 0;
+    for (; x + 4 <= n; x += 4) {
+      __m128i acc = _mm_setzero_si128();
+      for (unsigned int c = 0; c < 3; ++c) {
+        __m128i v =
+          _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>
+                                        (xt[c] + x)),
+                        vy[c]);
+        v = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(v)));
+        v = _mm_sub_epi32(_mm_xor_si128(v, vm[c]), vm[c]);
+        v = _mm_and_si128(_mm_add_epi32(vt[c], v), mask);
+        acc = _mm_or_si128(acc, _mm_sll_epi32(v, vs[c]));
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), acc);
+    }
+    unsigned int * const rest[3] = { xt[0] + x, xt[1] + x, xt[2] + x };
+    ellipticRow(out + x, rest, y, t, m, n - x);
+  }
 
-Pixmap bt::Image::renderPixmap(const Display &display, unsigned int screen) {
-  // get the colortable for the screen. if necessary, we will create one.
-  if (colorTableList.empty())
-    colorTableList.resize(display.screenCount(), 0);
 
-  if (!colorTableList[screen])
-    colorTableList[screen] = new XColorTable(display, screen, maximumColors());
+  __attribute__((target("sse2")))
+  static void interlaceRowSSE2(RGB *p, unsigned int n) {
+    const __m128i m1 = _mm_set1_epi8(0x7f), m2 = _mm_set1_epi8(0x3f);
+    unsigned int x = 0;
+    for (; x + 4 <= n; x += 4) {
+      __m128i * const q = reinterpret_cast<__m128i *>(p + x);
+      const __m128i v = _mm_loadu_si128(q);
+      _mm_storeu_si128(q,
+                       _mm_add_epi8(_mm_and_si128(_mm_srli_epi16(v, 1), m1),
+                                    _mm_and_si128(_mm_srli_epi16(v, 2), m2)));
+    }
+    interlaceRow(p + x, n - x);
+  }
 
-  XColorTable *colortable = colorTableList[screen];
-  const ScreenInfo &screeninfo = display.screenInfo(screen);
-  XImage *image = 0;
-  bool shm_ok = false;
 
-#ifdef MITSHM
-  // try to use MIT-SHM extension
-  if (use_shm) {
-    image = createShmImage(display, screeninfo, width, height);
-    shm_ok = (image != 0);
+  __attribute__((target("sse2")))
+  static void lightenRowSSE2(RGB *p, unsigned int n) {
+    const __m128i m1 = _mm_set1_epi8(0x7f);
+    unsigned int x = 0;
+    for (; x + 4 <= n; x += 4) {
+      __m128i * const q = reinterpret_cast<__m128i *>(p + x);
+      const __m128i v = _mm_loadu_si128(q);
+      _mm_storeu_si128(q,
+                       _mm_adds_epu8(v, _mm_and_si128(_mm_srli_epi16(v, 1),
+                                                      m1)));
+    }
+    lightenRow(p + x, n - x);
   }
-#endif // MITSHM
 
-  if (!shm_ok) {
-    // regular XImage
-    image = XCreateImage(display.XDisplay(), screeninfo.visual(),
-                         screeninfo.depth(), ZPixmap,
-                         0, 0, width, height, 32, 0);
-    if (!image)
-      return None;
 
-    buffer.reserve(image->bytes_per_line * (height + 1));
-    image->data = reinterpret_cast<char *>(&buffer[0]);
+  __attribute__((target("sse2")))
+  static void darkenRowSSE2(RGB *p, unsigned int n) {
+    const __m128i m1 = _mm_set1_epi8(0x7f), m2 = _mm_set1_epi8(0x3f);
+    unsigned int x = 0;
+    for (; x + 4 <= n; x += 4) {
+      __m128i * const q = reinterpret_cast<__m128i *>(p + x);
+      const __m128i v = _mm_loadu_si128(q);
+      _mm_storeu_si128(q,
+                       _mm_add_epi8(_mm_and_si128(_mm_srli_epi16(v, 2), m2),
+                                    _mm_and_si128(_mm_srli_epi16(v, 1), m1)));
+    }
+    darkenRow(p + x, n - x);
   }
 
-  unsigned char *d = reinterpret_cast<unsigned char *>(image->data);
-  unsigned int o = image->bits_per_pixel
-                   + ((image->byte_order == MSBFirst) ? 1 : 0);
 
-  DitherMode dmode =
-    (width > 1 && height > 1) ? colortable->ditherMode() : NoDither;
+  static const GradientKernels sse2_kernels = {
+    sumRowSSE2, max2RowSSE2, min2RowSSE2, ellipticRowSSE2,
+    interlaceRowSSE2, lightenRowSSE2, darkenRowSSE2
+  };
 
-  // render to XImage
-  switch (dmode) {
-  case bt::FloydSteinbergDither:
-    FloydSteinbergDither(colortable, o, image->bytes_per_line, d);
-    break;
 
-  case bt::OrderedDither:
-    OrderedDither(colortable, o, image->bytes_per_line, d);
-    break;
+  __attribute__((target("avx2")))
+  static void sumRowAVX2(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                         unsigned int n) {
+    const __m256i vy = _mm256_set1_epi32(packRGB(y));
+    const __m256i vt = _mm256_set1_epi32(packRGB(t));
+    const __m256i vm = _mm256_set1_epi32(packRGB(m));
+    unsigned int x = 0;
+    for (; x + 8 <= n; x += 8) {
+      __m256i v =
+        _mm256_add_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>
+                                           (xt + x)),
+                        vy);
+      v = _mm256_sub_epi8(_mm256_xor_si256(v, vm), vm);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x),
+                          _mm256_add_epi8(vt, v));
+    }
+    sumRowSSE2(out + x, xt + x, y, t, m, n - x);
+  }
 
-  case bt::NoDither: {
-    unsigned int x, y, offset, r, g, b;
-    unsigned char *pixel_data = d, *ppixel_data = d;
 
-    for (y = 0, offset = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++offset) {
-        r = data[offset].red;
-        g = data[offset].green;
-        b = data[offset].blue;
+  __attribute__((target("avx2")))
+  static void max2RowAVX2(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                          unsigned int n) {
+    const __m256i vy = _mm256_set1_epi32(packRGB(y));
+    const __m256i vt = _mm256_set1_epi32(packRGB(t));
+    const __m256i vm = _mm256_set1_epi32(packRGB(m));
+    unsigned int x = 0;
+    for (; x + 8 <= n; x += 8) {
+      __m256i v =
+        _mm256_max_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>
+                                           (xt + x)),
+                        vy);
+      v = _mm256_add_epi8(v, v);
+      v = _mm256_sub_epi8(_mm256_xor_si256(v, vm), vm);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x),
+                          _mm256_add_epi8(vt, v));
+    }
+    max2RowSSE2(out + x, xt + x, y, t, m, n - x);
+  }
 
-        colortable->map(r, g, b);
-        assignPixelData(o, &pixel_data, colortable->pixel(r, g, b));
+
+  __attribute__((target("avx2")))
+  static void min2RowAVX2(RGB *out, const RGB *xt, RGB y, RGB t, RGB m,
+                          unsigned int n) {
+    const __m256i vy = _mm256_set1_epi32(packRGB(y));
+    const __m256i vt = _mm256_set1_epi32(packRGB(t));
+    const __m256i vm = _mm256_set1_epi32(packRGB(m));
+    unsigned int x = 0;
+    for (; x + 8 <= n; x += 8) {
+      __m256i v =
+        _mm256_min_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>
+                                           (xt + x)),
+                        vy);
+      v = _mm256_add_epi8(v, v);
+      v = _mm256_sub_epi8(_mm256_xor_si256(v, vm), vm);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x),
+                          _mm256_add_epi8(vt, v));
+    }
+    min2RowSSE2(out + x, xt + x, y, t, m, n - x);
+  }
+
+
+  __attribute__((target("avx2")))
+  static void ellipticRowAVX2(RGB *out, unsigned int * const xt[3],
+                              const unsigned int y[3], RGB t, RGB m,
+                              unsigned int n) {
+    const unsigned char *tt = channels(&t), *mm = channels(&m);
+    __m256i vy[3], vt[3], vm[3];
+    __m128i vs[3];
+    for (unsigned int c = 0; c < 3; ++c) {
+      const int s = channelShift(c);
+      vy[c] = _mm256_set1_epi32(y[c]);
+      vt[c] = _mm256_set1_epi32(tt[s / 8]);
+      vm[c] = _mm256_set1_epi32(mm[s / 8] ? -1 : 0);
+      vs[c] = _mm_cvtsi32_si128(s);
+    }
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    unsigned int x = 0;
+    for (; x + 8 <= n; x += 8) {
+      __m256i acc = _mm256_setzero_si256();
+      for (unsigned int c = 0; c < 3; ++c) {
+        __m256i v =
+          _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>
+                                              (xt[c] + x)),
+                           vy[c]);
+        v = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(v)));
+        v = _mm256_sub_epi32(_mm256_xor_si256(v, vm[c]), vm[c]);
+        v = _mm256_and_si256(_mm256_add_epi32(vt[c], v), mask);
+        acc = _mm256_or_si256(acc, _mm256_sll_epi32(v, vs[c]));
       }
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), acc);
+    }
+    unsigned int * const rest[3] = { xt[0] + x, xt[1] + x, xt[2] + x };
+    ellipticRowSSE2(out + x, rest, y, t, m, n - x);
+  }
 
-      pixel_data = (ppixel_data += image->bytes_per_line);
+
+  __attribute__((target("avx2")))
+  static void interlaceRowAVX2(RGB *p, unsigned int n) {
+    const __m256i m1 = _mm256_set1_epi8(0x7f), m2 = _mm256_set1_epi8(0x3f);
+    unsigned int x = 0;
+    for (; x + 8 <= n; x += 8) {
+      __m256i * const q = reinterpret_cast<__m256i *>(p + x);
+      const __m256i v = _mm256_loadu_si256(q);
+      _mm256_storeu_si256(q,
+                          _mm256_add_epi8(_mm256_and_si256(_mm256_srli_epi16(v, 1),
+                                                           m1),
+                                          _mm256_and_si256(_mm256_srli_epi16(v, 2),
+                                                           m2)));
     }
-    break;
+    interlaceRowSSE2(p + x, n - x);
   }
-  } // switch dmode
 
-  Pixmap pixmap = XCreatePixmap(display.XDisplay(), screeninfo.rootWindow(),
-                                width, height, screeninfo.depth());
-  if (pixmap == None) {
-    image->data = 0;
-    XDestroyImage(image);
 
-    return None;
+  static const GradientKernels avx2_kernels = {
+    sumRowAVX2, max2RowAVX2, min2RowAVX2, ellipticRowAVX2,
+    interlaceRowAVX2, lightenRowSSE2, darkenRowSSE2
+  };
+#endif // BT_X86_SIMD
+
+
+  /*
+    Returns the fastest set of kernels supported by the CPU we are
+    running on.
+  */
+  static const GradientKernels &gradientKernels(void) {
+    static const GradientKernels *kernels = 0;
+    if (kernels)
+      return *kernels;
+
+    kernels = &scalar_kernels;
+#ifdef BT_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      kernels = &avx2_kernels;
+    else if (__builtin_cpu_supports("sse2"))
+      kernels = &sse2_kernels;
+#endif // BT_X86_SIMD
+    return *kernels;
   }
 
-  Pen pen(screen, Color(0, 0, 0));
 
-#ifdef MITSHM
-  if (shm_ok) {
-    // use MIT-SHM extension
-    XShmPutImage(pen.XDisplay(), pixmap, pen.gc(), image,
-                 0, 0, 0, 0, width, height, False);
+  class CombineJob : public ParallelJob {
+  public:
+    CombineJob(CombineKernel kernel, RowKernel interlace, bool interlaced,
+               RGB *data, unsigned int width,
+               const RGB *xt, const RGB *yt, RGB t, RGB m)
+      : _kernel(kernel), _interlace(interlaced ? interlace : 0),
+        _data(data), _width(width), _xt(xt), _yt(yt), _t(t), _m(m)
+    { }
+
+    void run(unsigned int begin, unsigned int end) {
+      RGB *p = _data + (begin * _width);
+      for (unsigned int y = begin; y < end; ++y, p += _width) {
+        _kernel(p, _xt, _yt[y], _t, _m, _width);
+
+        // interlacing effect
+        if (_interlace && (y & 1))
+          _interlace(p, _width);
+      }
+    }
 
-    destroyShmImage(display, image);
-  } else
-#endif // MITSHM
+  private:
+    CombineKernel _kernel;
+    RowKernel _interlace;
+    RGB *_data;
+    unsigned int _width;
+    const RGB *_xt, *_yt;
+    RGB _t, _m;
+  };
+
+
+  class EllipticJob : public ParallelJob {
+  public:
+    EllipticJob(EllipticKernel kernel, RowKernel interlace, bool interlaced,
+                RGB *data, unsigned int width,
+                unsigned int * const xt[3], unsigned int * const yt[3],
+                RGB t, RGB m)
+      : _kernel(kernel), _interlace(interlaced ? interlace : 0),
+        _data(data), _width(width), _t(t), _m(m)
     {
-      // normal XPutImage
-      XPutImage(pen.XDisplay(), pixmap, pen.gc(), image,
-                0, 0, 0, 0, width, height);
+      for (unsigned int i = 0; i < 3; ++i) {
+        _xt[i] = xt[i];
+        _yt[i] = yt[i];
+      }
+    }
 
-      image->data = 0;
-      XDestroyImage(image);
+    void run(unsigned int begin, unsigned int end) {
+      RGB *p = _data + (begin * _width);
+      for (unsigned int y = begin; y < end; ++y, p += _width) {
+        const unsigned int yv[3] = { _yt[0][y], _yt[1][y], _yt[2][y] };
+        _kernel(p, _xt, yv, _t, _m, _width);
+
+        // interlacing effect
+        if (_interlace && (y & 1))
+          _interlace(p, _width);
+      }
     }
 
-  return pixmap;
-}
+  private:
+    EllipticKernel _kernel;
+    RowKernel _interlace;
+    RGB *_data;
+    unsigned int _width;
+    unsigned int *_xt[3], *_yt[3];
+    RGB _t, _m;
+  };
 
+} // namespace bt
 
-void bt::Image::raisedBevel(unsigned int border_width) {
-  if (width <= 2 || height <= 2 ||
-      width <= (border_width * 4) || height <= (border_width * 4))
-    return;
 
+void bt::Image::raisedBevel(unsigned int border_width) {
+  const GradientKernels &kernels = gradientKernels();
   RGB *p = data + (border_width * width) + border_width;
-  unsigned int w = width - (border_width * 2);
+  const unsigned int w = width - (border_width * 2);
   unsigned int h = height - (border_width * 2) - 2;
-  unsigned char rr, gg, bb;
 
   // top of the bevel
-  do {
-    rr = p->red   + (p->red   >> 1);
-    gg = p->green + (p->green >> 1);
-    bb = p->blue  + (p->blue  >> 1);
-
-    if (rr < p->red  )
-      rr = ~0;
-    if (gg < p->green)
-      gg = ~0;
-    if (bb < p->blue )
-      bb = ~0;
-
-    p->red = rr;
-    p->green = gg;
-    p->blue = bb;
-
-    ++p;
-  } while (--w);
-
-  p += border_width + border_width;
-  w = width - (border_width * 2);
+  kernels.lighten(p, w);
+  p += width;
 
   // left and right of the bevel
   do {
-    rr = p->red   + (p->red   >> 1);
-    gg = p->green + (p->green >> 1);
-    bb = p->blue  + (p->blue  >> 1);
-
-    if (rr < p->red)
-      rr = ~0;
-    if (gg < p->green)
-      gg = ~0;
-    if (bb < p->blue)
-      bb = ~0;
-
-    p->red = rr;
-    p->green = gg;
-    p->blue = bb;
-
-    p += w - 1;
-
-    rr = (p->red   >> 2) + (p->red   >> 1);
-    gg = (p->green >> 2) + (p->green >> 1);
-    bb = (p->blue  >> 2) + (p->blue  >> 1);
-
-    if (rr > p->red  )
-      rr = 0;
-    if (gg > p->green)
-      gg = 0;
-    if (bb > p->blue )
-      bb = 0;
-
-    p->red   = rr;
-    p->green = gg;
-    p->blue  = bb;
-
-    p += border_width + border_width + 1;
+    lightenRow(p, 1);
+    darkenRow(p + w - 1, 1);
+    p += width;
   } while (--h);
 
-  w = width - (border_width * 2);
-
   // bottom of the bevel
-  do {
-    rr = (p->red   >> 2) + (p->red   >> 1);
-    gg = (p->green >> 2) + (p->green >> 1);
-    bb = (p->blue  >> 2) + (p->blue  >> 1);
-
-    if (rr > p->red  )
-      rr = 0;
-    if (gg > p->green)
-      gg = 0;
-    if (bb > p->blue )
-      bb = 0;
-
-    p->red   = rr;
-    p->green = gg;
-    p->blue  = bb;
-
-    ++p;
-  } while (--w);
+  kernels.darken(p, w);
 }
 
 
 void bt::Image::sunkenBevel(unsigned int border_width) {
-  if (width <= 2 || height <= 2 ||
-      width <= (border_width * 4) || height <= (border_width * 4))
-    return;
-
+  const GradientKernels &kernels = gradientKernels();
   RGB *p = data + (border_width * width) + border_width;
-  unsigned int w = width - (border_width * 2);
+  const unsigned int w = width - (border_width * 2);
   unsigned int h = height - (border_width * 2) - 2;
-  unsigned char rr, gg, bb;
 
   // top of the bevel
-  do {
-    rr = (p->red   >> 2) + (p->red   >> 1);
-    gg = (p->green >> 2) + (p->green >> 1);
-    bb = (p->blue  >> 2) + (p->blue  >> 1);
-
-    if (rr > p->red  )
-      rr = 0;
-    if (gg > p->green)
-      gg = 0;
-    if (bb > p->blue )
-      bb = 0;
-
-    p->red = rr;
-    p->green = gg;
-    p->blue = bb;
-
-    ++p;
-  } while (--w);
-
-  p += border_width + border_width;
-  w = width - (border_width * 2);
+  kernels.darken(p, w);
+  p += width;
 
   // left and right of the bevel
   do {
-    rr = (p->red   >> 2) + (p->red   >> 1);
-    gg = (p->green >> 2) + (p->green >> 1);
-    bb = (p->blue  >> 2) + (p->blue  >> 1);
-
-    if (rr > p->red  )
-      rr = 0;
-    if (gg > p->green)
-      gg = 0;
-    if (bb > p->blue )
-      bb = 0;
-
-    p->red = rr;
-    p->green = gg;
-    p->blue = bb;
-
-    p += w - 1;
-
-    rr = p->red   + (p->red   >> 1);
-    gg = p->green + (p->green >> 1);
-    bb = p->blue  + (p->blue  >> 1);
-
-    if (rr < p->red)
-      rr = ~0;
-    if (gg < p->green)
-      gg = ~0;
-    if (bb < p->blue)
-      bb = ~0;
-
-    p->red   = rr;
-    p->green = gg;
-    p->blue  = bb;
-
-    p += border_width + border_width + 1;
+    darkenRow(p, 1);
+    lightenRow(p + w - 1, 1);
+    p += width;
   } while (--h);
 
-  w = width - (border_width * 2);
-
   // bottom of the bevel
-  do {
-    rr = p->red   + (p->red   >> 1);
-    gg = p->green + (p->green >> 1);
-    bb = p->blue  + (p->blue  >> 1);
-
-    if (rr < p->red)
-      rr = ~0;
-    if (gg < p->green)
-      gg = ~0;
-    if (bb < p->blue)
-      bb = ~0;
-
-    p->red   = rr;
-    p->green = gg;
-    p->blue  = bb;
-
-    ++p;
-  } while (--w);
+  kernels.lighten(p, w);
 }
 
 
@@ -1208,19 +2394,11 @@ void bt::Image::dgradient(const Color &from, const Color &to,
          xg = static_cast<double>(from.green()),
          xb = static_cast<double>(from.blue());
 
-  RGB *p = data;
   unsigned int w = width * 2, h = height * 2;
   unsigned int x, y;
 
-  const unsigned int dimension = std::max(width, height);
-  unsigned int *alloc = new unsigned int[dimension * 6];
-  unsigned int *xt[3], *yt[3];
-  xt[0] = alloc + (dimension * 0);
-  xt[1] = alloc + (dimension * 1);
-  xt[2] = alloc + (dimension * 2);
-  yt[0] = alloc + (dimension * 3);
-  yt[1] = alloc + (dimension * 4);
-  yt[2] = alloc + (dimension * 5);
+  RGB *alloc = new RGB[width + height];
+  RGB *xt = alloc, *yt = alloc + width;
 
   dry = drx = static_cast<double>(to.red()   - from.red());
   dgy = dgx = static_cast<double>(to.green() - from.green());
@@ -1232,9 +2410,13 @@ void bt::Image::dgradient(const Color &from, const Color &to,
   dbx /= w;
 
   for (x = 0; x < width; ++x) {
-    xt[0][x] = static_cast<unsigned char>(xr);
-    xt[1][x] = static_cast<unsigned char>(xg);
-    xt[2][x] = static_cast<unsigned char>(xb);
+    const RGB rgb = {
+      static_cast<unsigned char>(xr),
+      static_cast<unsigned char>(xg),
+      static_cast<unsigned char>(xb),
+      0
+    };
+    xt[x] = rgb;
 
     xr += drx;
     xg += dgx;
@@ -1247,9 +2429,13 @@ void bt::Image::dgradient(const Color &from, const Color &to,
   dby /= h;
 
   for (y = 0; y < height; ++y) {
-    yt[0][y] = static_cast<unsigned char>(yr);
-    yt[1][y] = static_cast<unsigned char>(yg);
-    yt[2][y] = static_cast<unsigned char>(yb);
+    const RGB rgb = {
+      static_cast<unsigned char>(yr),
+      static_cast<unsigned char>(yg),
+      static_cast<unsigned char>(yb),
+      0
+    };
+    yt[y] = rgb;
 
     yr += dry;
     yg += dgy;
@@ -1257,32 +2443,12 @@ void bt::Image::dgradient(const Color &from, const Color &to,
   }
 
   // Combine tables to create gradient
+  const GradientKernels &kernels = gradientKernels();
+  const RGB zero = { 0, 0, 0, 0 };
 
-  if (!interlaced) {
-    // normal dgradient
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red   = xt[0][x] + yt[0][y];
-        p->green = xt[1][x] + yt[1][y];
-        p->blue  = xt[2][x] + yt[2][y];
-      }
-    }
-  } else {
-    // interlacing effect
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red   = xt[0][x] + yt[0][y];
-        p->green = xt[1][x] + yt[1][y];
-        p->blue  = xt[2][x] + yt[2][y];
-
-        if (y & 1) {
-          p->red   = (p->red   >> 1) + (p->red   >> 2);
-          p->green = (p->green >> 1) + (p->green >> 2);
-          p->blue  = (p->blue  >> 1) + (p->blue  >> 2);
-        }
-      }
-    }
-  }
+  CombineJob job(kernels.sum, kernels.interlace, interlaced,
+                 data, width, xt, yt, zero, zero);
+  parallelFor(job, height, bandRows(width));
 
   delete [] alloc;
 }
@@ -1431,19 +2597,11 @@ void bt::Image::pgradient(const Color &from, const Color &to,
 
   double yr, yg, yb, drx, dgx, dbx, dry, dgy, dby, xr, xg, xb;
   int rsign, gsign, bsign;
-  RGB *p = data;
   unsigned int tr = to.red(), tg = to.green(), tb = to.blue();
   unsigned int x, y;
 
-  const unsigned int dimension = std::max(width, height);
-  unsigned int *alloc = new unsigned int[dimension * 6];
-  unsigned int *xt[3], *yt[3];
-  xt[0] = alloc + (dimension * 0);
-  xt[1] = alloc + (dimension * 1);
-  xt[2] = alloc + (dimension * 2);
-  yt[0] = alloc + (dimension * 3);
-  yt[1] = alloc + (dimension * 4);
-  yt[2] = alloc + (dimension * 5);
+  RGB *alloc = new RGB[width + height];
+  RGB *xt = alloc, *yt = alloc + width;
 
   dry = drx = static_cast<double>(to.red()   - from.red());
   dgy = dgx = static_cast<double>(to.green() - from.green());
@@ -1463,9 +2621,13 @@ void bt::Image::pgradient(const Color &from, const Color &to,
   dbx /= width;
 
   for (x = 0; x < width; ++x) {
-    xt[0][x] = static_cast<unsigned char>(fabs(xr));
-    xt[1][x] = static_cast<unsigned char>(fabs(xg));
-    xt[2][x] = static_cast<unsigned char>(fabs(xb));
+    const RGB rgb = {
+      static_cast<unsigned char>(fabs(xr)),
+      static_cast<unsigned char>(fabs(xg)),
+      static_cast<unsigned char>(fabs(xb)),
+      0
+    };
+    xt[x] = rgb;
 
     xr -= drx;
     xg -= dgx;
@@ -1478,48 +2640,32 @@ void bt::Image::pgradient(const Color &from, const Color &to,
   dby /= height;
 
   for (y = 0; y < height; ++y) {
-    yt[0][y] = static_cast<unsigned char>(fabs(yr));
-    yt[1][y] = static_cast<unsigned char>(fabs(yg));
-    yt[2][y] = static_cast<unsigned char>(fabs(yb));
+    const RGB rgb = {
+      static_cast<unsigned char>(fabs(yr)),
+      static_cast<unsigned char>(fabs(yg)),
+      static_cast<unsigned char>(fabs(yb)),
+      0
+    };
+    yt[y] = rgb;
 
     yr -= dry;
     yg -= dgy;
     yb -= dby;
   }
 
-  // Combine tables to create gradient
+  // Combine tables to create gradient, to - (sign * (x + y))
+  const GradientKernels &kernels = gradientKernels();
+  const RGB t = { tr, tg, tb, 0 };
+  const RGB m = {
+    (rsign > 0) ? 0xffu : 0u,
+    (gsign > 0) ? 0xffu : 0u,
+    (bsign > 0) ? 0xffu : 0u,
+    0
+  };
 
-  if (!interlaced) {
-    // normal pgradient
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red =
-          static_cast<unsigned char>(tr - (rsign * (xt[0][x] + yt[0][y])));
-        p->green =
-          static_cast<unsigned char>(tg - (gsign * (xt[1][x] + yt[1][y])));
-        p->blue =
-          static_cast<unsigned char>(tb - (bsign * (xt[2][x] + yt[2][y])));
-      }
-    }
-  } else {
-    // interlacing effect
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red =
-          static_cast<unsigned char>(tr - (rsign * (xt[0][x] + yt[0][y])));
-        p->green =
-          static_cast<unsigned char>(tg - (gsign * (xt[1][x] + yt[1][y])));
-        p->blue =
-          static_cast<unsigned char>(tb - (bsign * (xt[2][x] + yt[2][y])));
-
-        if (y & 1) {
-          p->red   = (p->red   >> 1) + (p->red   >> 2);
-          p->green = (p->green >> 1) + (p->green >> 2);
-          p->blue  = (p->blue  >> 1) + (p->blue  >> 2);
-        }
-      }
-    }
-  }
+  CombineJob job(kernels.sum, kernels.interlace, interlaced,
+                 data, width, xt, yt, t, m);
+  parallelFor(job, height, bandRows(width));
 
   delete [] alloc;
 }
@@ -1533,19 +2679,11 @@ void bt::Image::rgradient(const Color &from, const Color &to,
 
   double drx, dgx, dbx, dry, dgy, dby, xr, xg, xb, yr, yg, yb;
   int rsign, gsign, bsign;
-  RGB *p = data;
   unsigned int tr = to.red(), tg = to.green(), tb = to.blue();
   unsigned int x, y;
 
-  const unsigned int dimension = std::max(width, height);
-  unsigned int *alloc = new unsigned int[dimension * 6];
-  unsigned int *xt[3], *yt[3];
-  xt[0] = alloc + (dimension * 0);
-  xt[1] = alloc + (dimension * 1);
-  xt[2] = alloc + (dimension * 2);
-  yt[0] = alloc + (dimension * 3);
-  yt[1] = alloc + (dimension * 4);
-  yt[2] = alloc + (dimension * 5);
+  RGB *alloc = new RGB[width + height];
+  RGB *xt = alloc, *yt = alloc + width;
 
   dry = drx = static_cast<double>(to.red()   - from.red());
   dgy = dgx = static_cast<double>(to.green() - from.green());
@@ -1565,9 +2703,13 @@ void bt::Image::rgradient(const Color &from, const Color &to,
   dbx /= width;
 
   for (x = 0; x < width; ++x) {
-    xt[0][x] = static_cast<unsigned char>(fabs(xr));
-    xt[1][x] = static_cast<unsigned char>(fabs(xg));
-    xt[2][x] = static_cast<unsigned char>(fabs(xb));
+    const RGB rgb = {
+      static_cast<unsigned char>(fabs(xr)),
+      static_cast<unsigned char>(fabs(xg)),
+      static_cast<unsigned char>(fabs(xb)),
+      0
+    };
+    xt[x] = rgb;
 
     xr -= drx;
     xg -= dgx;
@@ -1580,54 +2722,32 @@ void bt::Image::rgradient(const Color &from, const Color &to,
   dby /= height;
 
   for (y = 0; y < height; ++y) {
-    yt[0][y] = static_cast<unsigned char>(fabs(yr));
-    yt[1][y] = static_cast<unsigned char>(fabs(yg));
-    yt[2][y] = static_cast<unsigned char>(fabs(yb));
+    const RGB rgb = {
+      static_cast<unsigned char>(fabs(yr)),
+      static_cast<unsigned char>(fabs(yg)),
+      static_cast<unsigned char>(fabs(yb)),
+      0
+    };
+    yt[y] = rgb;
 
     yr -= dry;
     yg -= dgy;
     yb -= dby;
   }
 
-  // Combine tables to create gradient
+  // Combine tables to create gradient, to - (sign * max(x, y))
+  const GradientKernels &kernels = gradientKernels();
+  const RGB t = { tr, tg, tb, 0 };
+  const RGB m = {
+    (rsign > 0) ? 0xffu : 0u,
+    (gsign > 0) ? 0xffu : 0u,
+    (bsign > 0) ? 0xffu : 0u,
+    0
+  };
 
-  if (!interlaced) {
-    // normal rgradient
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red =
-          static_cast<unsigned char>(tr - (rsign *
-                                           std::max(xt[0][x], yt[0][y])));
-        p->green =
-          static_cast<unsigned char>(tg - (gsign *
-                                           std::max(xt[1][x], yt[1][y])));
-        p->blue =
-          static_cast<unsigned char>(tb - (bsign *
-                                           std::max(xt[2][x], yt[2][y])));
-      }
-    }
-  } else {
-    // interlacing effect
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red =
-          static_cast<unsigned char>(tr - (rsign *
-                                           std::max(xt[0][x], yt[0][y])));
-        p->green =
-          static_cast<unsigned char>(tg - (gsign *
-                                           std::max(xt[1][x], yt[1][y])));
-        p->blue =
-          static_cast<unsigned char>(tb - (bsign *
-                                           std::max(xt[2][x], yt[2][y])));
-
-        if (y & 1) {
-          p->red   = (p->red   >> 1) + (p->red   >> 2);
-          p->green = (p->green >> 1) + (p->green >> 2);
-          p->blue  = (p->blue  >> 1) + (p->blue  >> 2);
-        }
-      }
-    }
-  }
+  CombineJob job(kernels.max2, kernels.interlace, interlaced,
+                 data, width, xt, yt, t, m);
+  parallelFor(job, height, bandRows(width));
 
   delete [] alloc;
 }
@@ -1641,7 +2761,6 @@ void bt::Image::egradient(const Color &from, const Color &to,
 
   double drx, dgx, dbx, dry, dgy, dby, yr, yg, yb, xr, xg, xb;
   int rsign, gsign, bsign;
-  RGB *p = data;
   unsigned int tr = to.red(), tg = to.green(), tb = to.blue();
   unsigned int x, y;
 
@@ -1697,45 +2816,19 @@ void bt::Image::egradient(const Color &from, const Color &to,
     yb -= dby;
   }
 
-  // Combine tables to create gradient
+  // Combine tables to create gradient, to - (sign * sqrt(x + y))
+  const GradientKernels &kernels = gradientKernels();
+  const RGB t = { tr, tg, tb, 0 };
+  const RGB m = {
+    (rsign > 0) ? 0xffu : 0u,
+    (gsign > 0) ? 0xffu : 0u,
+    (bsign > 0) ? 0xffu : 0u,
+    0
+  };
 
-  if (!interlaced) {
-    // normal egradient
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red   = static_cast<unsigned char>
-                   (tr - (rsign * static_cast<int>(sqrt(xt[0][x] +
-                                                        yt[0][y]))));
-        p->green = static_cast<unsigned char>
-                   (tg - (gsign * static_cast<int>(sqrt(xt[1][x] +
-                                                        yt[1][y]))));
-        p->blue  = static_cast<unsigned char>
-                   (tb - (bsign * static_cast<int>(sqrt(xt[2][x] +
-                                                        yt[2][y]))));
-      }
-    }
-  } else {
-    // interlacing effect
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red   = static_cast<unsigned char>
-                   (tr - (rsign * static_cast<int>(sqrt(xt[0][x]
-                                                        + yt[0][y]))));
-        p->green = static_cast<unsigned char>
-                   (tg - (gsign * static_cast<int>(sqrt(xt[1][x]
-                                                        + yt[1][y]))));
-        p->blue  = static_cast<unsigned char>
-                   (tb - (bsign * static_cast<int>(sqrt(xt[2][x]
-                                                        + yt[2][y]))));
-
-        if (y & 1) {
-          p->red   = (p->red   >> 1) + (p->red   >> 2);
-          p->green = (p->green >> 1) + (p->green >> 2);
-          p->blue  = (p->blue  >> 1) + (p->blue  >> 2);
-        }
-      }
-    }
-  }
+  EllipticJob job(kernels.elliptic, kernels.interlace, interlaced,
+                  data, width, xt, yt, t, m);
+  parallelFor(job, height, bandRows(width));
 
   delete [] alloc;
 }
@@ -1749,19 +2842,11 @@ void bt::Image::pcgradient(const Color &from, const Color &to,
 
   double drx, dgx, dbx, dry, dgy, dby, xr, xg, xb, yr, yg, yb;
   int rsign, gsign, bsign;
-  RGB *p = data;
   unsigned int tr = to.red(), tg = to.green(), tb = to.blue();
   unsigned int x, y;
 
-  const unsigned int dimension = std::max(width, height);
-  unsigned int *alloc = new unsigned int[dimension * 6];
-  unsigned int *xt[3], *yt[3];
-  xt[0] = alloc + (dimension * 0);
-  xt[1] = alloc + (dimension * 1);
-  xt[2] = alloc + (dimension * 2);
-  yt[0] = alloc + (dimension * 3);
-  yt[1] = alloc + (dimension * 4);
-  yt[2] = alloc + (dimension * 5);
+  RGB *alloc = new RGB[width + height];
+  RGB *xt = alloc, *yt = alloc + width;
 
   dry = drx = static_cast<double>(to.red()   - from.red());
   dgy = dgx = static_cast<double>(to.green() - from.green());
@@ -1781,9 +2866,13 @@ void bt::Image::pcgradient(const Color &from, const Color &to,
   dbx /= width;
 
   for (x = 0; x < width; ++x) {
-    xt[0][x] = static_cast<unsigned char>(fabs(xr));
-    xt[1][x] = static_cast<unsigned char>(fabs(xg));
-    xt[2][x] = static_cast<unsigned char>(fabs(xb));
+    const RGB rgb = {
+      static_cast<unsigned char>(fabs(xr)),
+      static_cast<unsigned char>(fabs(xg)),
+      static_cast<unsigned char>(fabs(xb)),
+      0
+    };
+    xt[x] = rgb;
 
     xr -= drx;
     xg -= dgx;
@@ -1796,54 +2885,32 @@ void bt::Image::pcgradient(const Color &from, const Color &to,
   dby /= height;
 
   for (y = 0; y < height; ++y) {
-    yt[0][y] = static_cast<unsigned char>(fabs(yr));
-    yt[1][y] = static_cast<unsigned char>(fabs(yg));
-    yt[2][y] = static_cast<unsigned char>(fabs(yb));
+    const RGB rgb = {
+      static_cast<unsigned char>(fabs(yr)),
+      static_cast<unsigned char>(fabs(yg)),
+      static_cast<unsigned char>(fabs(yb)),
+      0
+    };
+    yt[y] = rgb;
 
     yr -= dry;
     yg -= dgy;
     yb -= dby;
   }
 
-  // Combine tables to create gradient
+  // Combine tables to create gradient, to - (sign * min(x, y))
+  const GradientKernels &kernels = gradientKernels();
+  const RGB t = { tr, tg, tb, 0 };
+  const RGB m = {
+    (rsign > 0) ? 0xffu : 0u,
+    (gsign > 0) ? 0xffu : 0u,
+    (bsign > 0) ? 0xffu : 0u,
+    0
+  };
 
-  if (!interlaced) {
-    // normal rgradient
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red =
-          static_cast<unsigned char>(tr - (rsign *
-                                           std::min(xt[0][x], yt[0][y])));
-        p->green =
-          static_cast<unsigned char>(tg - (gsign *
-                                           std::min(xt[1][x], yt[1][y])));
-        p->blue =
-          static_cast<unsigned char>(tb - (bsign *
-                                           std::min(xt[2][x], yt[2][y])));
-      }
-    }
-  } else {
-    // interlacing effect
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red =
-          static_cast<unsigned char>(tr - (rsign *
-                                           std::min(xt[0][x], yt[0][y])));
-        p->green =
-          static_cast<unsigned char>(tg - (gsign *
-                                           std::min(xt[1][x], yt[1][y])));
-        p->blue =
-          static_cast<unsigned char>(tb - (bsign *
-                                           std::min(xt[2][x], yt[2][y])));
-
-        if (y & 1) {
-          p->red   = (p->red   >> 1) + (p->red   >> 2);
-          p->green = (p->green >> 1) + (p->green >> 2);
-          p->blue  = (p->blue  >> 1) + (p->blue  >> 2);
-        }
-      }
-    }
-  }
+  CombineJob job(kernels.min2, kernels.interlace, interlaced,
+                 data, width, xt, yt, t, m);
+  parallelFor(job, height, bandRows(width));
 
   delete [] alloc;
 }
@@ -1860,19 +2927,11 @@ void bt::Image::cdgradient(const Color &from, const Color &to,
          xr = static_cast<double>(from.red()  ),
          xg = static_cast<double>(from.green()),
          xb = static_cast<double>(from.blue() );
-  RGB *p = data;
   unsigned int w = width * 2, h = height * 2;
   unsigned int x, y;
 
-  const unsigned int dimension = std::max(width, height);
-  unsigned int *alloc = new unsigned int[dimension * 6];
-  unsigned int *xt[3], *yt[3];
-  xt[0] = alloc + (dimension * 0);
-  xt[1] = alloc + (dimension * 1);
-  xt[2] = alloc + (dimension * 2);
-  yt[0] = alloc + (dimension * 3);
-  yt[1] = alloc + (dimension * 4);
-  yt[2] = alloc + (dimension * 5);
+  RGB *alloc = new RGB[width + height];
+  RGB *xt = alloc, *yt = alloc + width;
 
   dry = drx = static_cast<double>(to.red()   - from.red()  );
   dgy = dgx = static_cast<double>(to.green() - from.green());
@@ -1883,29 +2942,33 @@ void bt::Image::cdgradient(const Color &from, const Color &to,
   dgx /= w;
   dbx /= w;
 
-  for (x = width - 1; x != 0; --x) {
-    xt[0][x] = static_cast<unsigned char>(xr);
-    xt[1][x] = static_cast<unsigned char>(xg);
-    xt[2][x] = static_cast<unsigned char>(xb);
+  for (x = width; x-- > 0; ) {
+    const RGB rgb = {
+      static_cast<unsigned char>(xr),
+      static_cast<unsigned char>(xg),
+      static_cast<unsigned char>(xb),
+      0
+    };
+    xt[x] = rgb;
 
     xr += drx;
     xg += dgx;
     xb += dbx;
   }
 
-  xt[0][x] = static_cast<unsigned char>(xr);
-  xt[1][x] = static_cast<unsigned char>(xg);
-  xt[2][x] = static_cast<unsigned char>(xb);
-
   // Create Y table
   dry /= h;
   dgy /= h;
   dby /= h;
 
   for (y = 0; y < height; ++y) {
-    yt[0][y] = static_cast<unsigned char>(yr);
-    yt[1][y] = static_cast<unsigned char>(yg);
-    yt[2][y] = static_cast<unsigned char>(yb);
+    const RGB rgb = {
+      static_cast<unsigned char>(yr),
+      static_cast<unsigned char>(yg),
+      static_cast<unsigned char>(yb),
+      0
+    };
+    yt[y] = rgb;
 
     yr += dry;
     yg += dgy;
@@ -1913,32 +2976,12 @@ void bt::Image::cdgradient(const Color &from, const Color &to,
   }
 
   // Combine tables to create gradient
+  const GradientKernels &kernels = gradientKernels();
+  const RGB zero = { 0, 0, 0, 0 };
 
-  if (!interlaced) {
-    // normal dgradient
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red   = xt[0][x] + yt[0][y];
-        p->green = xt[1][x] + yt[1][y];
-        p->blue  = xt[2][x] + yt[2][y];
-      }
-    }
-  } else {
-    // interlacing effect
-    for (y = 0; y < height; ++y) {
-      for (x = 0; x < width; ++x, ++p) {
-        p->red   = xt[0][x] + yt[0][y];
-        p->green = xt[1][x] + yt[1][y];
-        p->blue  = xt[2][x] + yt[2][y];
-
-        if (y & 1) {
-          p->red   = (p->red   >> 1) + (p->red   >> 2);
-          p->green = (p->green >> 1) + (p->green >> 2);
-          p->blue  = (p->blue  >> 1) + (p->blue  >> 2);
-        }
-      }
-    }
-  }
+  CombineJob job(kernels.sum, kernels.interlace, interlaced,
+                 data, width, xt, yt, zero, zero);
+  parallelFor(job, height, bandRows(width));
 
   delete [] alloc;
 }
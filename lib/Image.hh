@@ -49,6 +49,43 @@ namespace bt {
     unsigned int reserved : 8;
   };
 
+  /*
+    Describes the layout of a TrueColor image in memory, for rendering
+    without an X server.  The default is 32 bits per pixel in host byte
+    order with 8 bits per channel (0x00rrggbb) and unpadded rows.
+  */
+  struct ImageFormat {
+    unsigned int bits_per_pixel; // 8, 16, 24 or 32
+    bool msb_first;
+    unsigned long red_mask, green_mask, blue_mask;
+    unsigned int bytes_per_line; // 0 means no padding
+
+    ImageFormat(void);
+  };
+
+  /*
+    The gradient that the RENDER extension draws for a texture.  The
+    server samples each pixel at its center, (x + 0.5, y + 0.5), and
+    finds its position t, where 0 is color1 and 1 is color2.  For a
+    linear gradient, t is the projection of the sample onto the line
+    from (x1, y1) to (x2, y2).  For a radial gradient, y is multiplied
+    by y_scale first, and t is 1 minus the distance of the sample from
+    (x1, y1) divided by radius.  t is clamped to [0, 1].
+  */
+  struct GradientGeometry {
+    bool radial;
+    double x1, y1, x2, y2;
+    double radius, y_scale;
+  };
+
+  /*
+    Returns false if RENDER cannot draw the gradient of the texture
+    like Image does.
+  */
+  bool gradientGeometry(unsigned long texture,
+                        unsigned int width, unsigned int height,
+                        GradientGeometry &geometry);
+
   class Image : public NoCopy {
   public:
     static inline unsigned int maximumColors(void)
@@ -67,6 +104,16 @@ namespace bt {
     Pixmap render(const Display &display, unsigned int screen,
                   const Texture &texture);
 
+    /*
+      Renders the texture into pixel_data, which holds height rows in
+      the specified format, using the current dither mode.  No display
+      is needed, so this can be used for tests and benchmarks.  Returns
+      false, leaving pixel_data untouched, if the format is not
+      supported or render() would not return a pixmap for the texture.
+    */
+    bool render(const Texture &texture, const ImageFormat &format,
+                unsigned char *pixel_data);
+
   private:
     RGB *data;
     unsigned int width, height;
@@ -80,8 +127,18 @@ namespace bt {
                               unsigned int bytes_per_line,
                               unsigned char *pixel_data);
 
+    void renderPixels(XColorTable *colortable,
+                      unsigned int bits_per_pixel, bool msb_first,
+                      unsigned int bytes_per_line,
+                      unsigned char *pixel_data);
     Pixmap renderPixmap(const Display &display, unsigned int screen);
+    Pixmap renderStrip(const Display &display, unsigned int screen,
+                       const Texture &texture, bool vertical);
 
+    void gradient(const Texture &texture);
+    void border(const Texture &texture);
+    void bevel(const Texture &texture,
+               unsigned int full_width, unsigned int full_height);
     void raisedBevel(unsigned int border_width = 0);
     void sunkenBevel(unsigned int border_width = 0);
     void dgradient(const Color &from, const Color &to, bool interlaced);
@@ -30,6 +30,7 @@
 #include "Pen.hh"
 #include "PixmapCache.hh"
 #include "Resource.hh"
+#include "Trace.hh"
 
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
@@ -326,6 +327,7 @@ bt::Menu::Menu(Application &app, unsigned int screen)
   _app.insertEventHandler(_window, this);
 
   _timer.setTimeout(200);
+  _timer.setSlack(50);
 }
 
 
@@ -339,6 +341,7 @@ bt::Menu::~Menu(void) {
   _tpixmap = _fpixmap = _apixmap = 0ul;
 
   _app.removeEventHandler(_window);
+  bt::Pen::clearCache(_window);
   XDestroyWindow(_app.XDisplay(), _window);
 }
 
@@ -603,6 +606,7 @@ void bt::Menu::move(int x, int y) {
 
 
 void bt::Menu::show(void) {
+  TraceSpan span("Menu::show");
   if (isVisible())
     return;
 
@@ -74,12 +74,12 @@ namespace bt {
     inline Menu *submenu(void) const
     { return sub; }
 
-    inline const ustring &label(void) const
+    inline const Utf8String &label(void) const
     { return lbl; }
 
   private:
     Menu *sub;
-    ustring lbl;
+    Utf8String lbl;
     unsigned int ident;
     unsigned int indx;
     unsigned int height;
@@ -28,6 +28,8 @@
 #include "Util.hh"
 
 #include <algorithm>
+#include <list>
+#include <map>
 
 #include <X11/Xlib.h>
 #ifdef XFT
@@ -42,18 +44,86 @@ namespace bt {
   class PenLoader
   {
     const Display &_display;
+
+    struct GCKey {
+      unsigned int screen;
+      unsigned long pixel;
+      int function;
+      int linewidth;
+      int subwindow;
+
+      inline bool operator<(const GCKey &x) const {
+        if (screen != x.screen)
+          return screen < x.screen;
+        if (pixel != x.pixel)
+          return pixel < x.pixel;
+        if (function != x.function)
+          return function < x.function;
+        if (linewidth != x.linewidth)
+          return linewidth < x.linewidth;
+        return subwindow < x.subwindow;
+      }
+    };
+
+    // unused GCs, most recently released first
+    typedef std::list<GCKey> IdleList;
+
+    struct GCRef {
+      GC gc;
+      unsigned int count;
+      IdleList::iterator idle;
+    };
+
+    typedef std::map<GCKey, GCRef> Cache;
+    typedef std::map<GC, Cache::iterator> GCIndex;
+
+    Cache cache;
+    GCIndex index;
+    IdleList idle;
+
+#ifdef XFT
+    typedef std::map<std::pair<Drawable, unsigned int>, XftDraw *> XftDrawCache;
+    XftDrawCache xftdraws;
+#endif
+
   public:
     PenLoader(const Display &display_)
       : _display(display_)
     { }
+    ~PenLoader(void);
+
     const Display &display(void) const
     { return _display; }
     ::Display *XDisplay(void) const
     { return _display.XDisplay(); }
+
+    /*
+      Returns a GC with the specified values, creating one if needed.
+      GCs are shared by all pens with the same values and must be
+      returned with release().
+    */
+    GC find(unsigned int screen, unsigned long pixel,
+            int function, int linewidth, int subwindow);
+    /*
+      Releases a GC returned by find().  Unused GCs are kept for
+      reuse, up to a limit; the least recently used are freed first.
+    */
+    void release(GC gc);
+
+    /*
+      Returns the XftDraw for the drawable on the given screen,
+      creating one if needed.  XftDraws are shared by all pens and
+      kept until clearXftDraw() is called for the drawable.
+    */
+    XftDraw *xftDraw(unsigned int screen, Drawable drawable);
+    void clearXftDraw(Drawable drawable);
   };
 
   static PenLoader *penloader = 0;
 
+  // the number of unused GCs kept by the pen loader
+  static const unsigned int maxIdleGCs = 32u;
+
   void createPenLoader(const Display &display)
   {
     assert(penloader == 0);
@@ -67,27 +137,135 @@ namespace bt {
 
 } // namespace bt
 
+bt::PenLoader::~PenLoader(void)
+{
+  Cache::iterator it = cache.begin();
+  for (; it != cache.end(); ++it)
+    XFreeGC(_display.XDisplay(), it->second.gc);
+
+#ifdef XFT
+  XftDrawCache::iterator x = xftdraws.begin();
+  for (; x != xftdraws.end(); ++x)
+    XftDrawDestroy(x->second);
+#endif
+}
+
+GC bt::PenLoader::find(unsigned int screen, unsigned long pixel,
+                       int function, int linewidth, int subwindow)
+{
+  GCKey key;
+  key.screen = screen;
+  key.pixel = pixel;
+  key.function = function;
+  key.linewidth = linewidth;
+  key.subwindow = subwindow;
+
+  Cache::iterator it = cache.find(key);
+  if (it != cache.end()) {
+    if (it->second.count++ == 0) {
+      idle.erase(it->second.idle);
+      it->second.idle = idle.end();
+    }
+    return it->second.gc;
+  }
+
+  XGCValues gcv;
+  gcv.foreground = pixel;
+  gcv.function = function;
+  gcv.line_width = linewidth;
+  gcv.subwindow_mode = subwindow;
+
+  GCRef ref;
+  ref.gc = XCreateGC(_display.XDisplay(),
+                     _display.screenInfo(screen).rootWindow(),
+                     (GCForeground
+                      | GCFunction
+                      | GCLineWidth
+                      | GCSubwindowMode),
+                     &gcv);
+  ref.count = 1u;
+  ref.idle = idle.end();
+
+  it = cache.insert(Cache::value_type(key, ref)).first;
+  index.insert(GCIndex::value_type(ref.gc, it));
+  return ref.gc;
+}
+
+void bt::PenLoader::release(GC gc)
+{
+  GCIndex::iterator i = index.find(gc);
+  assert(i != index.end());
+  Cache::iterator it = i->second;
+  assert(it->second.count > 0);
+
+  if (--it->second.count > 0)
+    return;
+
+  it->second.idle = idle.insert(idle.begin(), it->first);
+  if (idle.size() <= maxIdleGCs)
+    return;
+
+  // free the least recently used GC
+  Cache::iterator old = cache.find(idle.back());
+  assert(old != cache.end() && old->second.count == 0);
+  idle.pop_back();
+  XFreeGC(_display.XDisplay(), old->second.gc);
+  index.erase(old->second.gc);
+  cache.erase(old);
+}
+
+XftDraw *bt::PenLoader::xftDraw(unsigned int screen, Drawable drawable)
+{
+#ifdef XFT
+  const XftDrawCache::key_type key(drawable, screen);
+  XftDrawCache::iterator it = xftdraws.find(key);
+  if (it != xftdraws.end())
+    return it->second;
+
+  const ScreenInfo &screeninfo = _display.screenInfo(screen);
+  XftDraw *draw = XftDrawCreate(_display.XDisplay(),
+                                drawable,
+                                screeninfo.visual(),
+                                screeninfo.colormap());
+  if (draw)
+    xftdraws.insert(XftDrawCache::value_type(key, draw));
+  return draw;
+#else
+  (void) screen;
+  (void) drawable;
+  return 0;
+#endif
+}
+
+void bt::PenLoader::clearXftDraw(Drawable drawable)
+{
+#ifdef XFT
+  XftDrawCache::iterator it =
+    xftdraws.lower_bound(XftDrawCache::key_type(drawable, 0u));
+  while (it != xftdraws.end() && it->first.first == drawable) {
+    XftDrawDestroy(it->second);
+    xftdraws.erase(it++);
+  }
+#else
+  (void) drawable;
+#endif
+}
+
 bt::Pen::Pen(unsigned int screen_)
   : _screen(screen_), _function(GXcopy),  _linewidth(0),
-    _subwindow(ClipByChildren), _dirty(false), _gc(0), _xftdraw(0)
+    _subwindow(ClipByChildren), _dirty(false), _gc(0)
 { }
 
 bt::Pen::Pen(unsigned int screen_, const Color &color_)
   : _screen(screen_), _color(color_), _function(GXcopy), _linewidth(0),
-    _subwindow(ClipByChildren), _dirty(false), _gc(0), _xftdraw(0)
+    _subwindow(ClipByChildren), _dirty(false), _gc(0)
 { }
 
 bt::Pen::~Pen(void)
 {
   if (_gc)
-    XFreeGC(penloader->XDisplay(), _gc);
+    penloader->release(_gc);
   _gc = 0;
-
-#ifdef XFT
-  if (_xftdraw)
-    XftDrawDestroy(_xftdraw);
-  _xftdraw = 0;
-#endif
 }
 
 void bt::Pen::setColor(const Color &color_)
@@ -123,29 +301,13 @@ const bt::Display &bt::Pen::display(void) const
 const GC &bt::Pen::gc(void) const
 {
   if (!_gc || _dirty) {
-    XGCValues gcv;
-    gcv.foreground = _color.pixel(_screen);
-    gcv.function = _function;
-    gcv.line_width = _linewidth;
-    gcv.subwindow_mode = _subwindow;
-    if (!_gc) {
-      _gc = XCreateGC(penloader->XDisplay(),
-                      penloader->display().screenInfo(_screen).rootWindow(),
-                      (GCForeground
-                       | GCFunction
-                       | GCLineWidth
-                       | GCSubwindowMode),
-                      &gcv);
-
-    } else {
-      XChangeGC(penloader->XDisplay(),
-                _gc,
-                (GCForeground
-                 | GCFunction
-                 | GCLineWidth
-                 | GCSubwindowMode),
-                &gcv);
-    }
+    // find the new GC before releasing the old one, in case they are
+    // the same
+    GC gc = penloader->find(_screen, _color.pixel(_screen),
+                            _function, _linewidth, _subwindow);
+    if (_gc)
+      penloader->release(_gc);
+    _gc = gc;
     _dirty = false;
   }
   assert(_gc != 0);
@@ -154,20 +316,12 @@ const GC &bt::Pen::gc(void) const
 
 XftDraw *bt::Pen::xftDraw(Drawable drawable) const
 {
+  XftDraw *draw = penloader->xftDraw(_screen, drawable);
 #ifdef XFT
-  if (!_xftdraw) {
-    const ScreenInfo &screeninfo = penloader->display().screenInfo(_screen);
-    _xftdraw = XftDrawCreate(penloader->XDisplay(),
-                             drawable,
-                             screeninfo.visual(),
-                             screeninfo.colormap());
-  } else if (XftDrawDrawable(_xftdraw) != drawable) {
-    XftDrawChange(_xftdraw, drawable);
-  }
-  assert(_xftdraw != 0);
-  return _xftdraw;
-#else
-  return 0;
+  assert(draw != 0);
 #endif
+  return draw;
 }
 
+void bt::Pen::clearCache(Drawable drawable)
+{ penloader->clearXftDraw(drawable); }
@@ -57,6 +57,12 @@ namespace bt {
 
     XftDraw *xftDraw(Drawable drawable) const;
 
+    /*
+      Destroys the XftDraw objects cached for the drawable.  This must
+      be called before destroying a drawable that text was drawn on.
+    */
+    static void clearCache(Drawable drawable);
+
   private:
     unsigned int _screen;
 
@@ -67,7 +73,6 @@ namespace bt {
 
     mutable bool _dirty;
     mutable GC _gc;
-    mutable XftDraw *_xftdraw;
   };
 
 } // namespace bt
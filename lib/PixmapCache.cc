@@ -28,13 +28,18 @@
 #include "Display.hh"
 #include "Image.hh"
 #include "Texture.hh"
+#include "Timer.hh"
+#include "Trace.hh"
+#include "XIDTable.hh"
 
 #include <X11/Xlib.h>
 #include <assert.h>
 #include <cstdio>
+#include <cstring>
 
 #include <algorithm>
 #include <list>
+#include <vector>
 
 // #define PIXMAPCACHE_DEBUG
 
@@ -53,6 +58,8 @@ namespace bt {
     void release(Pixmap pixmap);
 
     void clear(bool force);
+    void evict(void);
+    void dump(FILE *file) const;
 
     struct CacheItem {
       const Texture texture;
@@ -61,45 +68,189 @@ namespace bt {
       const unsigned int height;
       Pixmap pixmap;
       unsigned int count;
+      unsigned long mem;
 
       inline CacheItem(void)
         : screen(~0u), width(0u), height(0u),
-          pixmap(0ul), count(0u)
+          pixmap(0ul), count(0u), mem(0ul)
       { }
       inline CacheItem(const unsigned int s, const Texture &t,
                        const unsigned int w, const unsigned int h)
         : texture(t), screen(s), width(w), height(h),
-          pixmap(0ul), count(1u)
+          pixmap(0ul), count(1u), mem(0ul)
       { }
-
-      inline bool operator==(const CacheItem &x) const {
-        return texture == x.texture &&
-                screen == x.screen &&
-                 width == x.width &&
-                height == x.height;
-      }
     };
 
-    struct PixmapMatch {
-      inline PixmapMatch(Pixmap p)
-        : pixmap(p)
-      { }
-      inline bool operator()(const RealPixmapCache::CacheItem& item) const
-      { return item.pixmap == pixmap; }
+    // the hash of everything that identifies an item
+    static inline unsigned long keyHash(unsigned int screen,
+                                        const Texture &texture,
+                                        unsigned int width,
+                                        unsigned int height) {
+      unsigned long hash = texture.fingerprint();
+      hash = (hash * 31ul) + screen;
+      hash = (hash * 31ul) + width;
+      hash = (hash * 31ul) + height;
+      return hash;
+    }
 
-      const Pixmap pixmap;
-    };
+    // bytes used by the server for a pixmap of the specified size
+    unsigned long pixmapMemory(unsigned int screen,
+                               unsigned int width, unsigned int height) const;
+
+    void remove(std::list<CacheItem>::iterator it);
 
     const Display &_display;
 
+    // the most recently used item is at the front
     typedef std::list<CacheItem> Cache;
     Cache cache;
+
+    /*
+      The items by keyHash(), in a flat hash table with linear probing
+      like XIDTable.  Items with equal hashes are told apart by
+      comparing their keys, and textures with equal fingerprints with
+      Texture::operator==.
+    */
+    class KeyIndex {
+    public:
+      inline KeyIndex(void)
+        : count(0u)
+      { }
+
+      bool find(unsigned long hash, unsigned int screen,
+                const Texture &texture,
+                unsigned int width, unsigned int height,
+                Cache::iterator &item) const {
+        if (count == 0u)
+          return false;
+        for (size_t i = slot(hash); slots[i].used; i = (i + 1) & mask()) {
+          const Cache::iterator it = slots[i].item;
+          if (slots[i].hash == hash && it->screen == screen
+              && it->width == width && it->height == height
+              && it->texture == texture) {
+            item = it;
+            return true;
+          }
+        }
+        return false;
+      }
+
+      void insert(unsigned long hash, Cache::iterator item) {
+        if ((count + 1u) * 2u > slots.size())
+          grow();
+        size_t i = slot(hash);
+        while (slots[i].used)
+          i = (i + 1) & mask();
+        slots[i].hash = hash;
+        slots[i].item = item;
+        slots[i].used = true;
+        ++count;
+      }
+
+      void erase(unsigned long hash, Cache::iterator item) {
+        size_t hole = slot(hash);
+        while (slots[hole].used && slots[hole].item != item)
+          hole = (hole + 1) & mask();
+        assert(slots[hole].used);
+
+        // see XIDTable::erase()
+        for (size_t i = (hole + 1) & mask(); slots[i].used;
+             i = (i + 1) & mask()) {
+          const size_t home = slot(slots[i].hash);
+          if (((i - home) & mask()) >= ((i - hole) & mask())) {
+            slots[hole] = slots[i];
+            hole = i;
+          }
+        }
+        slots[hole].used = false;
+        --count;
+      }
+
+    private:
+      struct Slot {
+        unsigned long hash;
+        Cache::iterator item;
+        bool used;
+
+        inline Slot(void)
+          : hash(0ul), used(false)
+        { }
+      };
+
+      inline size_t mask(void) const
+      { return slots.size() - 1u; }
+      inline size_t slot(unsigned long hash) const {
+        const unsigned long long h = hash * 0x9e3779b97f4a7c15ull;
+        return static_cast<size_t>(h >> 32) & mask();
+      }
+
+      void grow(void) {
+        std::vector<Slot> old(std::max<size_t>(slots.size() * 2u, 16u));
+        old.swap(slots);
+        count = 0u;
+        for (size_t i = 0; i < old.size(); ++i) {
+          if (old[i].used)
+            insert(old[i].hash, old[i].item);
+        }
+      }
+
+      std::vector<Slot> slots;
+      size_t count;
+    };
+    KeyIndex key_index;
+
+    XIDTable<Cache::iterator> pixmap_index;
+
+    // bits per pixel and scanline pad of the pixmap format for each screen
+    std::vector<unsigned int> bits_per_pixel, scanline_pad;
   };
 
 
   static RealPixmapCache *realpixmapcache = 0;
   static unsigned long maxmem_usage = 2ul*1024ul*1024ul; // 2mb default
   static unsigned long mem_usage = 0ul;
+  static PixmapCache::Statistics stats;
+
+
+  // same order as the gradient type selection in Image::render()
+  static const unsigned long statistics_types[] = {
+    Texture::Diagonal,
+    Texture::Elliptic,
+    Texture::Horizontal,
+    Texture::Pyramid,
+    Texture::Rectangle,
+    Texture::Vertical,
+    Texture::CrossDiagonal,
+    Texture::PipeCross,
+    Texture::SplitVertical
+  };
+
+
+  static void recordRender(const Texture &texture,
+                           unsigned int width, unsigned int height,
+                           Nanoseconds start, unsigned long bytes) {
+    const long usecs =
+      static_cast<long>((monotonicTime() - start) / 1000ll);
+
+    unsigned int type = 0;
+    while (type < PixmapCache::Statistics::TypeCount - 1
+           && !(texture.texture() & statistics_types[type]))
+      ++type;
+
+    unsigned int size = 0;
+    const unsigned long area = static_cast<unsigned long>(width) * height;
+    while (size < PixmapCache::Statistics::SizeCount - 1
+           && area >= (256ul << (size * 4)))
+      ++size;
+
+    unsigned int time = 0;
+    while (time < PixmapCache::Statistics::TimeCount - 1
+           && usecs >= (16l << time))
+      ++time;
+
+    ++stats.renders[type][size][time];
+    stats.bytes_rendered += bytes;
+  }
 
 
   void createPixmapCache(const Display &display) {
@@ -120,13 +271,44 @@ namespace bt {
 
 bt::RealPixmapCache::RealPixmapCache(const Display &display)
   : _display(display)
-{ }
+{
+  int count = 0;
+  XPixmapFormatValues *formats =
+    XListPixmapFormats(_display.XDisplay(), &count);
+
+  const unsigned int screens = _display.screenCount();
+  bits_per_pixel.resize(screens, 32u);
+  scanline_pad.resize(screens, 32u);
+  for (unsigned int i = 0; i < screens; ++i) {
+    const int depth = _display.screenInfo(i).depth();
+    for (int x = 0; x < count; ++x) {
+      if (formats[x].depth != depth)
+        continue;
+      bits_per_pixel[i] = formats[x].bits_per_pixel;
+      scanline_pad[i] = formats[x].scanline_pad;
+      break;
+    }
+  }
+
+  if (formats)
+    XFree(formats);
+}
 
 
 bt::RealPixmapCache::~RealPixmapCache(void)
 { clear(true); }
 
 
+unsigned long bt::RealPixmapCache::pixmapMemory(unsigned int screen,
+                                                unsigned int width,
+                                                unsigned int height) const {
+  const unsigned long pad = scanline_pad[screen];
+  const unsigned long line =
+    ((width * bits_per_pixel[screen] + pad - 1) / pad) * pad / 8;
+  return line * height;
+}
+
+
 Pixmap bt::RealPixmapCache::find(unsigned int screen,
                                  const Texture &texture,
                                  unsigned int width, unsigned int height,
@@ -139,53 +321,61 @@ Pixmap bt::RealPixmapCache::find(unsigned int screen,
   if (texture.texture() == Texture::Parent_Relative)
     return ParentRelative;
 
-  Pixmap p;
   // find one in the cache
-  CacheItem item(screen, texture, width, height);
-  Cache::iterator it = std::find(cache.begin(), cache.end(), item);
-
-  if (it != cache.end()) {
-    // found
+  const unsigned long hash = keyHash(screen, texture, width, height);
+  Cache::iterator it;
+  if (key_index.find(hash, screen, texture, width, height, it)) {
     ++(it->count);
-
-    p = it->pixmap;
+    ++stats.hits;
+    cache.splice(cache.begin(), cache, it);
 
 #ifdef PIXMAPCACHE_DEBUG
     fprintf(stderr, gettext("bt::PixmapCache: use %08lx %4ux%4u, count %4u\n"),
             it->pixmap, width, height, it->count);
 #endif // PIXMAPCACHE_DEBUG
-  } else {
-    Image image(width, height);
-    p = image.render(_display, screen, texture);
 
-    if (p) {
-      item.pixmap = p;
+    return it->pixmap;
+  }
+
+  ++stats.misses;
+
+  const Nanoseconds start = monotonicTime();
+
+  Image image(width, height);
+  Pixmap p = image.render(_display, screen, texture);
+
+  recordRender(texture, width, height, start,
+               p ? pixmapMemory(screen, width, height) : 0ul);
+
+  if (p) {
+    CacheItem item(screen, texture, width, height);
+    item.pixmap = p;
+    item.mem = pixmapMemory(screen, width, height);
 
 #ifdef PIXMAPCACHE_DEBUG
-      fprintf(stderr,
-              gettext("bt::PixmapCache: add %08lx %4ux%4u\n"
-                      "                 mem %8lu max %8lu\n"),
-              p, width, height, mem_usage, maxmem_usage);
+    fprintf(stderr,
+            gettext("bt::PixmapCache: add %08lx %4ux%4u\n"
+                    "                 mem %8lu max %8lu\n"),
+            p, width, height, mem_usage, maxmem_usage);
 #endif // PIXMAPCACHE_DEBUG
 
-      cache.push_front(item);
+    cache.push_front(item);
+    key_index.insert(hash, cache.begin());
+    pixmap_index.insert(p, cache.begin());
 
-      // keep track of memory usage server side
-      const unsigned long mem =
-        ( ( width * height ) * (_display.screenInfo(screen).depth() / 8 ) );
-      mem_usage += mem;
-      if (mem_usage > maxmem_usage)
-        clear(false);
+    // keep track of memory usage server side
+    mem_usage += item.mem;
+    if (mem_usage > maxmem_usage)
+      evict();
 
 #ifdef PIXMAPCACHE_DEBUG
-      if (mem_usage > maxmem_usage) {
-        fprintf(stderr,
-                gettext("bt::PixmapCache: maximum size (%lu kb) exceeded\n"
-                        "bt::PixmapCache: current size: %lu kb\n"),
-                maxmem_usage / 1024, mem_usage / 1024);
-      }
-#endif // PIXMAPCACHE_DEBUG
+    if (mem_usage > maxmem_usage) {
+      fprintf(stderr,
+              gettext("bt::PixmapCache: maximum size (%lu kb) exceeded\n"
+                      "bt::PixmapCache: current size: %lu kb\n"),
+              maxmem_usage / 1024, mem_usage / 1024);
     }
+#endif // PIXMAPCACHE_DEBUG
   }
 
   return p;
@@ -196,20 +386,69 @@ void bt::RealPixmapCache::release(Pixmap pixmap) {
   if (!pixmap || pixmap == ParentRelative)
     return;
 
-  Cache::iterator it = std::find_if(cache.begin(), cache.end(),
-                                    PixmapMatch(pixmap));
-  assert(it != cache.end() && it->count > 0);
+  Cache::iterator * const it = pixmap_index.find(pixmap);
+  assert(it != 0 && (*it)->count > 0);
 
   // decrement the refcount
-  --(it->count);
+  --((*it)->count);
 
 #ifdef PIXMAPCACHE_DEBUG
   fprintf(stderr, gettext("bt::PixmapCache: rel %08lx %4ux%4u, count %4u\n"),
-          it->pixmap, it->width, it->height, it->count);
+          (*it)->pixmap, (*it)->width, (*it)->height, (*it)->count);
 #endif // PIXMAPCACHE_DEBUG
 }
 
 
+void bt::RealPixmapCache::remove(Cache::iterator it) {
+#ifdef PIXMAPCACHE_DEBUG
+  fprintf(stderr, gettext("bt::PixmapCache: fre %08lx %4ux%4u\n"),
+          it->pixmap, it->width, it->height);
+#endif // PIXMAPCACHE_DEBUG
+
+  // keep track of memory usage server side
+  assert(it->mem <= mem_usage);
+  mem_usage -= it->mem;
+
+  // free pixmap
+  XFreePixmap(_display.XDisplay(), it->pixmap);
+
+  // remove from the indexes and the cache
+  pixmap_index.erase(it->pixmap);
+  key_index.erase(keyHash(it->screen, it->texture, it->width, it->height),
+                  it);
+  cache.erase(it);
+}
+
+
+void bt::RealPixmapCache::evict(void) {
+  // free unused pixmaps, least recently used first, until we are back
+  // under the limit
+  Cache::iterator it = cache.end();
+  while (mem_usage > maxmem_usage && it != cache.begin()) {
+    --it;
+    if (it->count != 0)
+      continue;
+
+    Cache::iterator unused = it++;
+    remove(unused);
+    ++stats.evictions;
+  }
+}
+
+
+void bt::RealPixmapCache::dump(FILE *file) const {
+  fprintf(file, "entries: %lu\n", static_cast<unsigned long>(cache.size()));
+
+  // most recently used first
+  Cache::const_iterator it = cache.begin(), end = cache.end();
+  for (; it != end; ++it) {
+    fprintf(file, "  %08lx %4ux%-4u screen %u count %3u %8lu bytes  %s\n",
+            it->pixmap, it->width, it->height, it->screen, it->count,
+            it->mem, it->texture.description().c_str());
+  }
+}
+
+
 void bt::RealPixmapCache::clear(bool force) {
   if (cache.empty())
     return; // nothing to do
@@ -231,23 +470,7 @@ void bt::RealPixmapCache::clear(bool force) {
       continue;
     }
 
-#ifdef PIXMAPCACHE_DEBUG
-    fprintf(stderr, gettext("bt::PixmapCache: fre %08lx %4ux%4u\n"),
-            it->pixmap, it->width, it->height);
-#endif // PIXMAPCACHE_DEBUG
-
-    // keep track of memory usage server side
-    const unsigned long mem =
-      ( ( it->width * it->height ) *
-        (_display.screenInfo(it->screen).depth() / 8 ) );
-    assert(mem <= mem_usage);
-    mem_usage -= mem;
-
-    // free pixmap
-    XFreePixmap(_display.XDisplay(), it->pixmap);
-
-    // remove from cache
-    it = cache.erase(it);
+    remove(it++);
   }
 
 #ifdef PIXMAPCACHE_DEBUG
@@ -263,8 +486,11 @@ unsigned long bt::PixmapCache::cacheLimit(void)
 { return maxmem_usage / 1024; }
 
 
-void bt::PixmapCache::setCacheLimit(unsigned long limit)
-{ maxmem_usage = limit * 1024; }
+void bt::PixmapCache::setCacheLimit(unsigned long limit) {
+  maxmem_usage = limit * 1024;
+  if (realpixmapcache && mem_usage > maxmem_usage)
+    realpixmapcache->evict();
+}
 
 
 unsigned long bt::PixmapCache::memoryUsage(void)
@@ -274,8 +500,14 @@ unsigned long bt::PixmapCache::memoryUsage(void)
 Pixmap bt::PixmapCache::find(unsigned int screen,
                              const Texture &texture,
                              unsigned int width, unsigned int height,
-                             Pixmap old_pixmap)
-{ return realpixmapcache->find(screen, texture, width, height, old_pixmap); }
+                             Pixmap old_pixmap) {
+  TraceSpan span("PixmapCache::find");
+  const Pixmap pixmap =
+    realpixmapcache->find(screen, texture, width, height, old_pixmap);
+  if (tracing())
+    traceCounter("PixmapCache memory (kb)", memoryUsage());
+  return pixmap;
+}
 
 
 void bt::PixmapCache::release(Pixmap pixmap)
@@ -284,3 +516,69 @@ void bt::PixmapCache::release(Pixmap pixmap)
 
 void bt::PixmapCache::clearCache(void)
 { realpixmapcache->clear(false); }
+
+
+const char *bt::PixmapCache::Statistics::typeName(unsigned int type) {
+  static const char * const names[TypeCount] = {
+    "diagonal", "elliptic", "horizontal", "pyramid", "rectangle",
+    "vertical", "crossdiagonal", "pipecross", "splitvertical", "other"
+  };
+  return (type < TypeCount) ? names[type] : "";
+}
+
+
+bt::PixmapCache::Statistics bt::PixmapCache::statistics(void)
+{ return stats; }
+
+
+void bt::PixmapCache::resetStatistics(void)
+{ memset(&stats, 0, sizeof(stats)); }
+
+
+bool bt::PixmapCache::dumpStatistics(const std::string &filename) {
+  FILE *file = fopen(filename.c_str(), "w");
+  if (!file)
+    return false;
+
+  fprintf(file,
+          "limit: %lu kb\n"
+          "usage: %lu kb\n"
+          "hits: %lu\n"
+          "misses: %lu\n"
+          "evictions: %lu\n"
+          "bytes rendered: %lu\n",
+          cacheLimit(), memoryUsage(), stats.hits, stats.misses,
+          stats.evictions, stats.bytes_rendered);
+
+  // one line per texture type and size, with the render time buckets
+  // as columns
+  static const char * const sizes[Statistics::SizeCount] = {
+    "<16x16", "<64x64", "<256x256", "<1024x1024", "<4096x4096", "larger"
+  };
+  fprintf(file, "renders by time (microseconds):\n%-14s %-11s",
+          "type", "size");
+  for (unsigned int t = 0; t < Statistics::TimeCount - 1; ++t)
+    fprintf(file, " %7lu", 16ul << t);
+  fprintf(file, "    more\n");
+
+  for (unsigned int type = 0; type < Statistics::TypeCount; ++type) {
+    for (unsigned int size = 0; size < Statistics::SizeCount; ++size) {
+      const unsigned long *renders = stats.renders[type][size];
+      bool any = false;
+      for (unsigned int t = 0; t < Statistics::TimeCount; ++t)
+        any = any || renders[t] != 0;
+      if (!any)
+        continue;
+
+      fprintf(file, "%-14s %-11s", Statistics::typeName(type), sizes[size]);
+      for (unsigned int t = 0; t < Statistics::TimeCount; ++t)
+        fprintf(file, " %7lu", renders[t]);
+      fprintf(file, "\n");
+    }
+  }
+
+  if (realpixmapcache)
+    realpixmapcache->dump(file);
+
+  return (fclose(file) == 0);
+}
@@ -83,6 +83,50 @@ namespace bt {
     */
     static void clearCache(void);
 
+    /*
+      Counters describing the behavior of the cache since startup or
+      the last call to resetStatistics().
+    */
+    struct Statistics {
+      enum {
+        // texture types, in the order returned by typeName()
+        TypeCount = 10,
+        // image sizes: less than 16x16, 64x64, 256x256, 1024x1024,
+        // 4096x4096 pixels, and larger
+        SizeCount = 6,
+        // render times: less than 16 << n microseconds, the last
+        // bucket holds everything slower
+        TimeCount = 16
+      };
+
+      unsigned long hits;
+      unsigned long misses;
+      unsigned long evictions;
+      unsigned long bytes_rendered;
+
+      // number of renders by texture type, size and render time
+      unsigned long renders[TypeCount][SizeCount][TimeCount];
+
+      static const char *typeName(unsigned int type);
+    };
+
+    /*
+      Returns a snapshot of the cache statistics.
+    */
+    static Statistics statistics(void);
+
+    /*
+      Resets all cache statistics to zero.
+    */
+    static void resetStatistics(void);
+
+    /*
+      Writes the cache statistics and contents in human readable form
+      to the specified file.  Returns false if the file could not be
+      written.
+    */
+    static bool dumpStatistics(const std::string &filename);
+
   private:
     // static only interface
     PixmapCache();
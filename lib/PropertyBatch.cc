@@ -0,0 +1,246 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// PropertyBatch.cc for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#include "PropertyBatch.hh"
+#include "Display.hh"
+
+#ifdef    XCB
+#  include <X11/Xlib-xcb.h>
+#  include <xcb/xcb.h>
+#endif // XCB
+
+#include <assert.h>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+
+namespace bt {
+
+  static PropertyBatch *active_batch = 0;
+
+  // the size of one item in Xlib's representation of the property
+  static size_t clientItemSize(int format) {
+    switch (format) {
+    case 16: return sizeof(short);
+    case 32: return sizeof(long);
+    default: break;
+    }
+    return 1;
+  }
+
+} // namespace bt
+
+
+bt::PropertyBatch::PropertyBatch(const Display &display, Window window)
+  : _display(display), _window(window)
+{ }
+
+
+bt::PropertyBatch::~PropertyBatch(void)
+{ release(); }
+
+
+void bt::PropertyBatch::request(Atom property, long length) {
+  Reply reply;
+  reply.property = property;
+  reply.length = length;
+  reply.cookie = 0u;
+  reply.status = BadImplementation;
+  reply.type = None;
+  reply.format = 0;
+  reply.nitems = reply.bytes_after = 0ul;
+  replies.push_back(reply);
+}
+
+
+void bt::PropertyBatch::fetch(void) {
+  assert(active_batch == 0 || active_batch == this);
+
+#ifdef    XCB
+  xcb_connection_t * const c = XGetXCBConnection(_display.XDisplay());
+
+  // send all requests before waiting for the first reply
+  std::vector<Reply>::iterator it = replies.begin(), end = replies.end();
+  for (; it != end; ++it) {
+    it->cookie = xcb_get_property(c, 0, _window, it->property,
+                                  XCB_GET_PROPERTY_TYPE_ANY, 0,
+                                  it->length).sequence;
+  }
+
+  for (it = replies.begin(); it != end; ++it) {
+    xcb_get_property_cookie_t cookie;
+    cookie.sequence = it->cookie;
+    xcb_generic_error_t *error = 0;
+    xcb_get_property_reply_t * const reply =
+      xcb_get_property_reply(c, cookie, &error);
+    if (!reply) {
+      it->status = error ? error->error_code : BadImplementation;
+      free(error);
+      continue;
+    }
+
+    it->status = Success;
+    it->type = reply->type;
+    it->format = reply->format;
+    it->nitems = reply->value_len;
+    it->bytes_after = reply->bytes_after;
+
+    /*
+      convert the items to the types that Xlib returns.  Like
+      _XRead32(), format 32 items are sign extended to long.
+    */
+    const size_t size = clientItemSize(it->format);
+    it->data.resize(it->nitems * size);
+    const void * const value = xcb_get_property_value(reply);
+    for (unsigned long i = 0; i < it->nitems; ++i) {
+      switch (it->format) {
+      case 16: {
+        const short s = static_cast<short>(
+          static_cast<const int16_t *>(value)[i]);
+        memcpy(&it->data[i * size], &s, size);
+        break;
+      }
+      case 32: {
+        const long l = static_cast<long>(
+          static_cast<const int32_t *>(value)[i]);
+        memcpy(&it->data[i * size], &l, size);
+        break;
+      }
+      default:
+        it->data[i] = static_cast<const unsigned char *>(value)[i];
+        break;
+      }
+    }
+    free(reply);
+  }
+#else
+  // without XCB each property is still read with a single request
+  std::vector<Reply>::iterator it = replies.begin(), end = replies.end();
+  for (; it != end; ++it) {
+    unsigned char *data = 0;
+    it->status = XGetWindowProperty(_display.XDisplay(), _window,
+                                    it->property, 0l, it->length, False,
+                                    AnyPropertyType, &it->type, &it->format,
+                                    &it->nitems, &it->bytes_after, &data);
+    if (it->status == Success && data)
+      it->data.assign(data, data + it->nitems * clientItemSize(it->format));
+    if (data)
+      XFree(data);
+  }
+#endif // XCB
+
+  active_batch = this;
+}
+
+
+void bt::PropertyBatch::release(void) {
+  if (active_batch == this)
+    active_batch = 0;
+  replies.clear();
+}
+
+
+/*
+ * Answers a read of {property} from the batch, in the same way as the
+ * server would.  Returns -1 if the read has to be sent to the server.
+ */
+int bt::PropertyBatch::find(Window window, Atom property,
+                            long offset, long length, Atom req_type,
+                            Atom *actual_type, int *actual_format,
+                            unsigned long *nitems,
+                            unsigned long *bytes_after,
+                            unsigned char **prop) const {
+  if (window != _window || offset != 0l || length < 0l)
+    return -1;
+
+  std::vector<Reply>::const_iterator it = replies.begin(),
+                                    end = replies.end();
+  while (it != end && it->property != property)
+    ++it;
+  if (it == end)
+    return -1;
+
+  *prop = 0;
+  *actual_type = None;
+  *actual_format = 0;
+  *nitems = *bytes_after = 0ul;
+
+  if (it->status != Success)
+    return it->status;
+  if (it->type == None)
+    return Success;
+
+  *actual_type = it->type;
+  *actual_format = it->format;
+
+  // the sizes are in bytes on the wire
+  const unsigned long unit = it->format / 8;
+  const unsigned long fetched = it->nitems * unit;
+  const unsigned long total = fetched + it->bytes_after;
+  if (req_type != AnyPropertyType && req_type != it->type) {
+    *bytes_after = total;
+    return Success;
+  }
+
+  const unsigned long wanted =
+    std::min(static_cast<unsigned long>(length) * 4ul, total);
+  if (wanted > fetched)
+    return -1;
+
+  const unsigned long count = wanted / unit;
+  const size_t size = count * clientItemSize(it->format);
+  // Xlib always allocates, and terminates the data for string users
+  unsigned char * const data = static_cast<unsigned char *>(malloc(size + 1));
+  if (!data)
+    return BadAlloc;
+  if (size > 0)
+    memcpy(data, &it->data[0], size);
+  data[size] = '\0';
+
+  *nitems = count;
+  *bytes_after = total - (count * unit);
+  *prop = data;
+  return Success;
+}
+
+
+int bt::getWindowProperty(::Display *display, Window window, Atom property,
+                          long offset, long length, Atom req_type,
+                          Atom *actual_type, int *actual_format,
+                          unsigned long *nitems, unsigned long *bytes_after,
+                          unsigned char **prop) {
+  if (active_batch) {
+    const int ret = active_batch->find(window, property, offset, length,
+                                       req_type, actual_type, actual_format,
+                                       nitems, bytes_after, prop);
+    if (ret != -1)
+      return ret;
+  }
+
+  return XGetWindowProperty(display, window, property, offset, length,
+                            False, req_type, actual_type, actual_format,
+                            nitems, bytes_after, prop);
+}
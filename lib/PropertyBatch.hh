@@ -0,0 +1,112 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// PropertyBatch.hh for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __PropertyBatch_hh
+#define   __PropertyBatch_hh
+
+#include "Util.hh"
+
+#include <X11/Xlib.h>
+
+#include <vector>
+
+namespace bt {
+
+  // forward declarations
+  class Display;
+
+  /*
+    Fetches several properties of one window at once.  When libbt is
+    built with XCB, all GetProperty requests are sent before the first
+    reply is read, so the whole batch costs a single round trip.
+
+    After fetch(), getWindowProperty() answers reads of the window's
+    properties from the batch until release() is called or the batch
+    is destroyed.  The properties must not change in the meantime, so
+    a batch should only be used while the server is grabbed.  Only one
+    batch can be active at a time, and only on the main thread.
+  */
+  class PropertyBatch : public NoCopy {
+  public:
+    PropertyBatch(const Display &display, Window window);
+    ~PropertyBatch(void);
+
+    /*
+      Queues a request for {property}, reading at most {length} 32-bit
+      units.  Reads of more than {length} units are sent to the server.
+    */
+    void request(Atom property, long length);
+
+    /*
+      Sends the queued requests, waits for the replies and makes the
+      batch active.
+    */
+    void fetch(void);
+
+    /*
+      Discards the replies.  Later reads are sent to the server.
+    */
+    void release(void);
+
+  private:
+    struct Reply {
+      Atom property;
+      long length;
+      unsigned int cookie;
+      int status;
+      Atom type;
+      int format;
+      unsigned long nitems, bytes_after;
+      // the items in Xlib's representation, i.e. longs for format 32
+      std::vector<unsigned char> data;
+    };
+
+    int find(Window window, Atom property, long offset, long length,
+             Atom req_type, Atom *actual_type, int *actual_format,
+             unsigned long *nitems, unsigned long *bytes_after,
+             unsigned char **prop) const;
+    friend int getWindowProperty(::Display *, Window, Atom, long, long, Atom,
+                                 Atom *, int *, unsigned long *,
+                                 unsigned long *, unsigned char **);
+
+    const Display &_display;
+    Window _window;
+    std::vector<Reply> replies;
+  };
+
+  /*
+    Same as XGetWindowProperty() with delete set to False, except that
+    the property is taken from the active PropertyBatch if it has been
+    fetched already.  The data returned in {prop} must be freed with
+    XFree().
+  */
+  int getWindowProperty(::Display *display, Window window, Atom property,
+                        long offset, long length, Atom req_type,
+                        Atom *actual_type, int *actual_format,
+                        unsigned long *nitems, unsigned long *bytes_after,
+                        unsigned char **prop);
+
+} // namespace bt
+
+#endif // __PropertyBatch_hh
@@ -64,6 +64,8 @@ void bt::Texture::setColor1(const bt::Color &new_color) {
   if (bb > b)
     bb = 0;
   sc.setRGB(rr, gg, bb);
+
+  updateFingerprint();
 }
 
 
@@ -124,11 +126,32 @@ bt::Texture& bt::Texture::operator=(const bt::Texture &tt) {
   sc = tt.sc;
   t  = tt.t;
   bw = tt.bw;
+  fp = tt.fp;
 
   return *this;
 }
 
 
+void bt::Texture::updateFingerprint(void) {
+  // FNV-1a.  the light and shadow colors are derived from color1, and
+  // the description only matters through the texture type.  where
+  // unsigned long has 64 bits, the upper half comes from a second hash
+  // with a different offset basis.
+  const int values[] = {
+    c1.red(), c1.green(), c1.blue(),
+    c2.red(), c2.green(), c2.blue(),
+    bc.red(), bc.green(), bc.blue(),
+    static_cast<int>(t), static_cast<int>(bw)
+  };
+  unsigned int lo = 2166136261u, hi = 3735928559u;
+  for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    lo = (lo ^ static_cast<unsigned int>(values[i])) * 16777619u;
+    hi = (hi ^ static_cast<unsigned int>(values[i])) * 16777619u;
+  }
+  fp = lo | ((static_cast<unsigned long>(hi) << 16) << 16);
+}
+
+
 bt::Texture bt::textureResource(const Display &display,
                                 unsigned int screen,
                                 const bt::Resource &resource,
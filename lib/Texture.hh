@@ -98,7 +98,7 @@ namespace bt {
 
     inline Texture(void)
       : t(0ul), bw(0u)
-    { }
+    { updateFingerprint(); }
     inline Texture(const Texture &tt)
     { *this = tt; }
 
@@ -108,9 +108,9 @@ namespace bt {
 
     void setColor1(const Color &new_color);
     inline void setColor2(const Color &new_color)
-    { c2 = new_color; }
+    { c2 = new_color; updateFingerprint(); }
     inline void setBorderColor(const Color &new_borderColor)
-    { bc = new_borderColor; }
+    { bc = new_borderColor; updateFingerprint(); }
 
     inline const Color &color1(void) const
     { return c1; }
@@ -126,28 +126,40 @@ namespace bt {
     inline unsigned long texture(void) const
     { return t; }
     inline void setTexture(unsigned long _texture)
-    { t  = _texture; }
+    { t  = _texture; updateFingerprint(); }
     inline void addTexture(unsigned long _texture)
-    { t |= _texture; }
+    { t |= _texture; updateFingerprint(); }
 
     inline unsigned int borderWidth(void) const
     { return bw; }
     inline void setBorderWidth(unsigned int new_bw)
-    { bw = new_bw; }
+    { bw = new_bw; updateFingerprint(); }
+
+    /*
+      Returns a hash of everything that operator== compares.  Equal
+      textures have equal fingerprints, so textures with different
+      fingerprints can be told apart without comparing them.
+    */
+    inline unsigned long fingerprint(void) const
+    { return fp; }
 
     Texture &operator=(const Texture &tt);
     inline bool operator==(const Texture &tt) const {
-      return (c1 == tt.c1 && c2 == tt.c2 && bc == tt.bc &&
+      return (fp == tt.fp &&
+              c1 == tt.c1 && c2 == tt.c2 && bc == tt.bc &&
               lc == tt.lc && sc == tt.sc && t == tt.t && bw == tt.bw);
     }
     inline bool operator!=(const Texture &tt) const
     { return (!operator==(tt)); }
 
   private:
+    void updateFingerprint(void);
+
     std::string descr;
     Color c1, c2, bc, lc, sc;
     unsigned long t;
     unsigned int bw;
+    unsigned long fp;
   };
 
 } // namespace bt
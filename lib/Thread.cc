@@ -0,0 +1,376 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Thread.cc for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#include "Thread.hh"
+
+#include <algorithm>
+#include <list>
+#include <vector>
+
+#include <assert.h>
+
+#ifdef    THREADS
+#  include <pthread.h>
+#  include <signal.h>
+#  include <unistd.h>
+#endif // THREADS
+
+
+namespace bt {
+
+#ifdef    THREADS
+  class WorkerPool : public NoCopy {
+  public:
+    explicit WorkerPool(unsigned int count);
+    ~WorkerPool(void);
+
+    void run(ParallelJob &job, unsigned int count, unsigned int bands);
+
+  private:
+    static void *start(void *pool);
+    void work(void);
+    bool runBand(void);
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wake, done;
+    std::vector<pthread_t> threads;
+
+    // the current job, protected by mutex
+    ParallelJob *job;
+    unsigned int count, band_size, band_count, next_band, bands_done;
+    unsigned long generation;
+    bool quit;
+  };
+
+
+  static WorkerPool *pool = 0;
+
+
+  class BackgroundThread : public NoCopy {
+  public:
+    BackgroundThread(void);
+    ~BackgroundThread(void);
+
+    void queue(BackgroundJob &job);
+    void wait(BackgroundJob &job);
+
+  private:
+    static void *start(void *thread);
+    void work(void);
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wake, done;
+    pthread_t thread;
+    bool started;
+
+    // queued jobs, protected by mutex
+    std::list<BackgroundJob *> jobs;
+    bool quit;
+  };
+
+
+  static BackgroundThread *background = 0;
+#endif // THREADS
+
+  static unsigned int thread_count = 0u; // automatic
+  static bool running = false;
+
+
+  void stopWorkerThreads(void) {
+#ifdef    THREADS
+    delete pool;
+    pool = 0;
+    // runs the remaining background jobs first
+    delete background;
+    background = 0;
+#endif // THREADS
+  }
+
+} // namespace bt
+
+
+#ifdef    THREADS
+bt::WorkerPool::WorkerPool(unsigned int n)
+  : job(0), count(0u), band_size(0u), band_count(0u), next_band(0u),
+    bands_done(0u), generation(0ul), quit(false)
+{
+  pthread_mutex_init(&mutex, 0);
+  pthread_cond_init(&wake, 0);
+  pthread_cond_init(&done, 0);
+
+  // the workers never handle signals, so that they keep interrupting
+  // the main thread's event loop
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+
+  threads.reserve(n);
+  for (unsigned int i = 0; i < n; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, 0, start, this) != 0)
+      break;
+    threads.push_back(thread);
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, 0);
+}
+
+
+bt::WorkerPool::~WorkerPool(void) {
+  pthread_mutex_lock(&mutex);
+  quit = true;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&mutex);
+
+  for (unsigned int i = 0; i < threads.size(); ++i)
+    pthread_join(threads[i], 0);
+
+  pthread_cond_destroy(&done);
+  pthread_cond_destroy(&wake);
+  pthread_mutex_destroy(&mutex);
+}
+
+
+void bt::WorkerPool::run(ParallelJob &j, unsigned int c, unsigned int bands) {
+  pthread_mutex_lock(&mutex);
+  job = &j;
+  count = c;
+  band_size = (count + bands - 1) / bands;
+  // rounding band_size up can leave the last bands empty, drop them
+  band_count = (count + band_size - 1) / band_size;
+  next_band = 0u;
+  bands_done = 0u;
+  ++generation;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&mutex);
+
+  // help out until no bands are left, then wait for the stragglers
+  while (runBand())
+    ;
+
+  pthread_mutex_lock(&mutex);
+  while (bands_done < band_count)
+    pthread_cond_wait(&done, &mutex);
+  job = 0;
+  pthread_mutex_unlock(&mutex);
+}
+
+
+void *bt::WorkerPool::start(void *pool) {
+  static_cast<WorkerPool *>(pool)->work();
+  return 0;
+}
+
+
+void bt::WorkerPool::work(void) {
+  unsigned long seen = 0ul;
+
+  pthread_mutex_lock(&mutex);
+  for (;;) {
+    while (!quit && generation == seen)
+      pthread_cond_wait(&wake, &mutex);
+    if (quit)
+      break;
+    seen = generation;
+
+    pthread_mutex_unlock(&mutex);
+    while (runBand())
+      ;
+    pthread_mutex_lock(&mutex);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+bool bt::WorkerPool::runBand(void) {
+  pthread_mutex_lock(&mutex);
+  if (next_band == band_count) {
+    pthread_mutex_unlock(&mutex);
+    return false;
+  }
+  const unsigned int band = next_band++;
+  ParallelJob * const j = job;
+  pthread_mutex_unlock(&mutex);
+
+  const unsigned int begin = band * band_size;
+  j->run(begin, std::min(begin + band_size, count));
+
+  pthread_mutex_lock(&mutex);
+  if (++bands_done == band_count)
+    pthread_cond_signal(&done);
+  pthread_mutex_unlock(&mutex);
+  return true;
+}
+
+
+bt::BackgroundThread::BackgroundThread(void)
+  : started(false), quit(false)
+{
+  pthread_mutex_init(&mutex, 0);
+  pthread_cond_init(&wake, 0);
+  pthread_cond_init(&done, 0);
+
+  // see WorkerPool::WorkerPool()
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  started = (pthread_create(&thread, 0, start, this) == 0);
+  pthread_sigmask(SIG_SETMASK, &old, 0);
+}
+
+
+bt::BackgroundThread::~BackgroundThread(void) {
+  if (started) {
+    pthread_mutex_lock(&mutex);
+    quit = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, 0);
+  }
+  assert(jobs.empty());
+
+  pthread_cond_destroy(&done);
+  pthread_cond_destroy(&wake);
+  pthread_mutex_destroy(&mutex);
+}
+
+
+void bt::BackgroundThread::queue(BackgroundJob &job) {
+  if (!started) {
+    job.run();
+    return;
+  }
+
+  pthread_mutex_lock(&mutex);
+  job._queued = true;
+  jobs.push_back(&job);
+  pthread_cond_signal(&wake);
+  pthread_mutex_unlock(&mutex);
+}
+
+
+void bt::BackgroundThread::wait(BackgroundJob &job) {
+  pthread_mutex_lock(&mutex);
+  while (job._queued)
+    pthread_cond_wait(&done, &mutex);
+  pthread_mutex_unlock(&mutex);
+}
+
+
+void *bt::BackgroundThread::start(void *thread) {
+  static_cast<BackgroundThread *>(thread)->work();
+  return 0;
+}
+
+
+void bt::BackgroundThread::work(void) {
+  pthread_mutex_lock(&mutex);
+  for (;;) {
+    while (!quit && jobs.empty())
+      pthread_cond_wait(&wake, &mutex);
+    if (jobs.empty())
+      break; // quit once the queue is empty
+
+    BackgroundJob * const job = jobs.front();
+    pthread_mutex_unlock(&mutex);
+    job->run();
+    pthread_mutex_lock(&mutex);
+
+    jobs.pop_front();
+    job->_queued = false;
+    pthread_cond_broadcast(&done);
+  }
+  pthread_mutex_unlock(&mutex);
+}
+#endif // THREADS
+
+
+void bt::parallelFor(ParallelJob &job, unsigned int count,
+                     unsigned int min_band) {
+  const unsigned int threads = threadCount();
+  min_band = std::max(min_band, 1u);
+  // a few bands per thread keeps everyone busy when some finish early
+  const unsigned int bands = std::min(count / min_band, threads * 4u);
+
+  if (threads < 2u || bands < 2u || running) {
+    job.run(0u, count);
+    return;
+  }
+
+#ifdef    THREADS
+  if (!pool)
+    pool = new WorkerPool(threads - 1u);
+
+  running = true;
+  pool->run(job, count, bands);
+  running = false;
+#endif // THREADS
+}
+
+
+unsigned int bt::threadCount(void) {
+#ifdef    THREADS
+  if (thread_count == 0u) {
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = static_cast<unsigned int>(std::min(std::max(n, 1l), 16l));
+  }
+  return thread_count;
+#else
+  return 1u;
+#endif // THREADS
+}
+
+
+void bt::setThreadCount(unsigned int count) {
+  stopWorkerThreads();
+  thread_count = std::max(count, 1u);
+}
+
+
+bt::BackgroundJob::BackgroundJob(void)
+  : _queued(false)
+{ }
+
+
+bt::BackgroundJob::~BackgroundJob(void)
+{ assert(!_queued); }
+
+
+void bt::BackgroundJob::start(void) {
+#ifdef    THREADS
+  if (!background)
+    background = new BackgroundThread;
+  background->queue(*this);
+#else
+  run();
+#endif // THREADS
+}
+
+
+void bt::BackgroundJob::wait(void) {
+#ifdef    THREADS
+  if (background)
+    background->wait(*this);
+#endif // THREADS
+}
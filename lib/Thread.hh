@@ -0,0 +1,100 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Thread.hh for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Thread_hh
+#define   __Thread_hh
+
+#include "Util.hh"
+
+namespace bt {
+
+  /*
+    A piece of work that can be split into independent bands.  run()
+    may be called concurrently from several threads with disjoint
+    ranges, so it must not call into Xlib or touch shared state.
+  */
+  class ParallelJob : public NoCopy {
+  public:
+    virtual ~ParallelJob(void) { }
+    virtual void run(unsigned int begin, unsigned int end) = 0;
+  };
+
+  /*
+    Runs job over the range [0, count), split into bands of at least
+    min_band items.  The bands are spread over a pool of worker
+    threads and the calling thread; parallelFor() returns once all of
+    them are done.  Small ranges, nested calls and builds without
+    thread support run the whole range on the calling thread.
+
+    parallelFor() must only be called from the main thread.
+  */
+  void parallelFor(ParallelJob &job, unsigned int count,
+                   unsigned int min_band = 1u);
+
+  /*
+    Returns the number of threads (including the calling thread) that
+    parallelFor() uses.  The default is the number of online
+    processors, at most 16.
+  */
+  unsigned int threadCount(void);
+
+  /*
+    Sets the number of threads used by parallelFor().  A count of 1
+    disables the worker threads.
+  */
+  void setThreadCount(unsigned int count);
+
+  /*
+    A piece of work that runs on a background thread while the main
+    thread carries on.  Jobs run one at a time, in the order they were
+    started.  Like ParallelJob::run(), run() must not call into Xlib.
+    A started job must be waited for before it is destroyed.
+  */
+  class BackgroundJob : public NoCopy {
+  public:
+    BackgroundJob(void);
+    virtual ~BackgroundJob(void);
+
+    /*
+      Queues the job.  Builds without thread support run it on the
+      calling thread before returning.
+    */
+    void start(void);
+    /*
+      Waits until the job has run.  Returns immediately if the job
+      was never started.
+    */
+    void wait(void);
+
+  protected:
+    virtual void run(void) = 0;
+
+  private:
+    friend class BackgroundThread;
+    bool _queued;
+  };
+
+} // namespace bt
+
+#endif // __Thread_hh
@@ -25,6 +25,9 @@
 #include "Timer.hh"
 
 #include <sys/time.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
 
 
 bt::timeval::timeval(const ::timeval &t)
@@ -85,46 +88,57 @@ bt::timeval bt::normalizeTimeval(const timeval &tm) {
 }
 
 
+bt::Nanoseconds bt::monotonicTime(void) {
+#if defined(_POSIX_MONOTONIC_CLOCK) && _POSIX_MONOTONIC_CLOCK >= 0
+  timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (ts.tv_sec * 1000000000ll) + ts.tv_nsec;
+#endif
+
+  // no monotonic clock, fall back to the system time
+  ::timeval tv;
+  gettimeofday(&tv, 0);
+  return (tv.tv_sec * 1000000000ll) + (tv.tv_usec * 1000ll);
+}
+
+
 bt::Timer::Timer(TimerQueueManager *m, TimeoutHandler *h) {
   manager = m;
   handler = h;
 
   recur = timing = false;
+  _start = _timeout = _slack = 0ll;
+  heap_index = unqueued;
 }
 
 
 bt::Timer::~Timer(void) {
-  if (timing)
+  // a timer restarted from its own timeout is queued but not timing
+  if (timing || heap_index != unqueued)
     stop();
 }
 
 
 void printTime(const char *message, const bt::timeval &tv);
 
-void bt::Timer::adjustStartTime(const timeval &offset)
-{ _start += offset; }
+void bt::Timer::setTimeout(long t)
+{ _timeout = t * 1000000ll; }
 
 
-void bt::Timer::setTimeout(long t) {
-  _timeout.tv_sec = t / 1000;
-  _timeout.tv_usec = t % 1000;
-  _timeout.tv_usec *= 1000;
-}
+void bt::Timer::setTimeout(const timeval &t)
+{ _timeout = (t.tv_sec * 1000000000ll) + (t.tv_usec * 1000ll); }
 
 
-void bt::Timer::setTimeout(const timeval &t)
-{ _timeout = t; }
+void bt::Timer::setSlack(long t)
+{ _slack = std::max(t, 0l) * 1000000ll; }
 
 
 void bt::Timer::start(void) {
-  ::timeval s;
-  gettimeofday(&s, 0);
-  _start = s;
+  _start = monotonicTime();
 
-  if (!timing) {
-    timing = true;
-    manager->addTimer(this);
-  }
+  // the manager moves the timer if it is already queued
+  timing = true;
+  manager->addTimer(this);
 }
 
 
@@ -145,29 +159,98 @@ void bt::Timer::fireTimeout(void)
 }
 
 
-bt::timeval bt::Timer::timeRemaining(const timeval &tm) const {
-  timeval ret = endpoint();
+void bt::TimerQueue::push(Timer *timer) {
+  if (timer->heap_index == unqueued) {
+    heap.push_back(timer);
+    timer->heap_index = heap.size() - 1;
+  }
+  // the endpoint may have moved in either direction
+  siftUp(timer->heap_index);
+  siftDown(timer->heap_index);
+}
 
-  ret.tv_sec  -= tm.tv_sec;
-  ret.tv_usec -= tm.tv_usec;
 
-  return bt::normalizeTimeval(ret);
+void bt::TimerQueue::pop(void) {
+  release(heap.front());
 }
 
 
-bt::timeval bt::Timer::endpoint(void) const {
-  timeval ret;
+void bt::TimerQueue::release(Timer *timer) {
+  const size_t index = timer->heap_index;
+  if (index == unqueued)
+    return;
+  assert(index < heap.size() && heap[index] == timer);
 
-  ret.tv_sec = _start.tv_sec + _timeout.tv_sec;
-  ret.tv_usec = _start.tv_usec + _timeout.tv_usec;
+  timer->heap_index = unqueued;
+  Timer * const last = heap.back();
+  heap.pop_back();
+  if (last == timer)
+    return;
 
-  return bt::normalizeTimeval(ret);
+  place(last, index);
+  siftUp(index);
+  siftDown(last->heap_index);
 }
 
 
-bool bt::Timer::shouldFire(const timeval &tm) const {
-  timeval end = endpoint();
+bt::Nanoseconds bt::TimerQueue::deadline(void) const {
+  assert(!heap.empty());
+  return deadline(0, heap.front()->latest());
+}
+
 
-  return !((tm.tv_sec < end.tv_sec) ||
-           (tm.tv_sec == end.tv_sec && tm.tv_usec < end.tv_usec));
+/*
+  the children of a timer never expire before it, so the search stops
+  at the first timer on each path whose endpoint is not before the
+  deadline found so far.  The recursion is no deeper than the heap,
+  which is log2 of the number of timers.
+*/
+bt::Nanoseconds bt::TimerQueue::deadline(size_t index,
+                                         Nanoseconds ret) const {
+  if (index >= heap.size() || !(heap[index]->endpoint() < ret))
+    return ret;
+  ret = std::min(ret, heap[index]->latest());
+
+  const size_t child = (index * 2) + 1;
+  return deadline(child + 1, deadline(child, ret));
+}
+
+
+void bt::TimerQueue::place(Timer *timer, size_t index) {
+  heap[index] = timer;
+  timer->heap_index = index;
+}
+
+
+void bt::TimerQueue::siftUp(size_t index) {
+  Timer * const timer = heap[index];
+  const Nanoseconds end = timer->endpoint();
+  while (index > 0) {
+    const size_t parent = (index - 1) / 2;
+    if (!(end < heap[parent]->endpoint()))
+      break;
+    place(heap[parent], index);
+    index = parent;
+  }
+  place(timer, index);
+}
+
+
+void bt::TimerQueue::siftDown(size_t index) {
+  Timer * const timer = heap[index];
+  const Nanoseconds end = timer->endpoint();
+  const size_t count = heap.size();
+  for (;;) {
+    size_t child = (index * 2) + 1;
+    if (child >= count)
+      break;
+    if (child + 1 < count
+        && heap[child + 1]->endpoint() < heap[child]->endpoint())
+      ++child;
+    if (!(heap[child]->endpoint() < end))
+      break;
+    place(heap[child], index);
+    index = child;
+  }
+  place(timer, index);
 }
@@ -62,6 +62,13 @@ namespace bt {
 
   timeval normalizeTimeval(const timeval &tm);
 
+  /*
+    Timers measure time in nanoseconds on the monotonic clock, which is
+    not affected by changes to the system time.
+  */
+  typedef long long Nanoseconds;
+  Nanoseconds monotonicTime(void);
+
   // forward declaration
   class TimerQueueManager;
   class Timer;
@@ -78,7 +85,11 @@ namespace bt {
     TimeoutHandler *handler;
     bool timing, recur;
 
-    timeval _start, _timeout;
+    Nanoseconds _start, _timeout, _slack;
+
+    // the position in the TimerQueue, if queued
+    size_t heap_index;
+    friend class TimerQueue;
 
   public:
     Timer(TimerQueueManager *m, TimeoutHandler *h);
@@ -91,18 +102,23 @@ namespace bt {
     inline bool isRecurring(void) const
     { return recur; }
 
-    inline const timeval &timeout(void) const
+    inline Nanoseconds timeout(void) const
     { return _timeout; }
-    inline const timeval &startTime(void) const
+    inline Nanoseconds startTime(void) const
     { return _start; }
-
-    // adjust the start time by the given offset... this is done when
-    // the clock rolls back
-    void adjustStartTime(const timeval &offset);
-
-    timeval timeRemaining(const timeval &tm) const;
-    bool shouldFire(const timeval &tm) const;
-    timeval endpoint(void) const;
+    inline Nanoseconds slack(void) const
+    { return _slack; }
+
+    // the arguments and results are monotonicTime() values
+    inline Nanoseconds timeRemaining(Nanoseconds now) const
+    { return std::max(endpoint() - now, 0ll); }
+    inline bool shouldFire(Nanoseconds now) const
+    { return now >= endpoint(); }
+    inline Nanoseconds endpoint(void) const
+    { return _start + _timeout; }
+    // the timer may fire anywhere between endpoint() and latest()
+    inline Nanoseconds latest(void) const
+    { return endpoint() + _slack; }
 
     inline void recurring(bool b)
     { recur = b; }
@@ -110,54 +126,63 @@ namespace bt {
     void setTimeout(long t);
     void setTimeout(const timeval &t);
 
+    /*
+      Allows the timer to fire up to {t} milliseconds late, so that
+      its expiration can be batched with other timers.  The default is
+      zero.
+    */
+    void setSlack(long t);
+
     void start(void);  // manager acquires timer
     void stop(void);   // manager releases timer
     void halt(void);   // halts the timer
 
     inline bool operator<(const Timer& other) const
-    { return shouldFire(other.endpoint()); }
+    { return endpoint() <= other.endpoint(); }
   };
 
-  template <class _Tp, class _Sequence, class _Compare>
-  class _timer_queue: protected std::priority_queue<_Tp, _Sequence, _Compare> {
-  public:
-    typedef std::priority_queue<_Tp, _Sequence, _Compare> _Base;
 
-    inline _timer_queue(void)
-      : _Base()
-    { }
-    inline ~_timer_queue(void)
-    { }
+  // the heap_index of timers that are not queued
+  const size_t unqueued = ~static_cast<size_t>(0);
 
-    inline void release(const _Tp& value) {
-      _Base::c.erase(std::remove(_Base::c.begin(), _Base::c.end(), value),
-                     _Base::c.end());
-      // after removing the item we need to make the heap again
-      std::make_heap(_Base::c.begin(), _Base::c.end(), _Base::comp);
-    }
+  /*
+    A binary heap of timers, ordered by endpoint.  Each timer knows its
+    position in the heap, so a timer can be removed or moved without
+    searching for it.  All operations are O(log n).
+  */
+  class TimerQueue : public NoCopy {
+  public:
     inline bool empty(void) const
-    { return _Base::empty(); }
+    { return heap.empty(); }
     inline size_t size(void) const
-    { return _Base::size(); }
-    inline void push(const _Tp& value)
-    { _Base::push(value); }
-    inline void pop(void)
-    { _Base::pop(); }
-    inline const _Tp& top(void) const
-    { return _Base::top(); }
+    { return heap.size(); }
+    // the timer with the earliest endpoint
+    inline Timer *top(void) const
+    { return heap.front(); }
+
+    // inserts the timer, or moves it if it is already queued
+    void push(Timer *timer);
+    void pop(void);
+    // removes the timer if it is queued
+    void release(Timer *timer);
+
+    /*
+      Returns the latest time at which all due timers can be fired
+      together, which is the earliest latest() of the queued timers.
+      Only the timers with endpoints before that time are visited.
+    */
+    Nanoseconds deadline(void) const;
+
   private:
-    // no copying!
-    _timer_queue(const _timer_queue&);
-    _timer_queue& operator=(const _timer_queue&);
-  };
+    // searches the subtree at {index} for an earlier deadline than {ret}
+    Nanoseconds deadline(size_t index, Nanoseconds ret) const;
+    void place(Timer *timer, size_t index);
+    void siftUp(size_t index);
+    void siftDown(size_t index);
 
-  struct TimerLessThan {
-    inline bool operator()(const Timer* const l, const Timer* const r) const
-    { return *r < *l; }
+    std::vector<Timer*> heap;
   };
 
-  typedef _timer_queue<Timer*, std::vector<Timer*>, TimerLessThan> TimerQueue;
-
   class TimerQueueManager {
   public:
     inline virtual ~TimerQueueManager() { }
@@ -0,0 +1,122 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Trace.cc for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#include "Trace.hh"
+#include "Timer.hh"
+
+#include <cstdio>
+#include <unistd.h>
+
+
+bool bt::trace_enabled = false;
+
+
+namespace bt {
+
+  static FILE *trace_file = 0;
+  static long trace_pid = 0;
+  static bool trace_first = true;
+
+  // starts a new event in the trace event array
+  static void beginEvent(void) {
+    fputs(trace_first ? "\n" : ",\n", trace_file);
+    trace_first = false;
+  }
+
+  // writes {str} as a JSON string
+  static void writeString(const char *str) {
+    fputc('"', trace_file);
+    for (; *str; ++str) {
+      const unsigned char c = *str;
+      if (c == '"' || c == '\\')
+        fprintf(trace_file, "\\%c", c);
+      else if (c < 0x20)
+        fprintf(trace_file, "\\u%04x", c);
+      else
+        fputc(c, trace_file);
+    }
+    fputc('"', trace_file);
+  }
+
+} // namespace bt
+
+
+bool bt::startTrace(const std::string &filename) {
+  stopTrace();
+
+  trace_file = fopen(filename.c_str(), "w");
+  if (!trace_file)
+    return false;
+
+  trace_pid = static_cast<long>(getpid());
+  trace_first = true;
+  fputs("[", trace_file);
+  trace_enabled = true;
+  return true;
+}
+
+
+void bt::stopTrace(void) {
+  if (!trace_file)
+    return;
+
+  trace_enabled = false;
+  fputs("\n]\n", trace_file);
+  fclose(trace_file);
+  trace_file = 0;
+}
+
+
+long long bt::traceTime(void)
+{ return monotonicTime() / 1000ll; }
+
+
+void bt::traceSpan(const char *name, const char *detail, long long start) {
+  const long long end = traceTime();
+
+  // a complete event, with the times in microseconds
+  beginEvent();
+  fprintf(trace_file,
+          "{\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%lld,\"dur\":%lld,"
+          "\"name\":", trace_pid, trace_pid, start, end - start);
+  writeString(name);
+  if (detail) {
+    fputs(",\"args\":{\"detail\":", trace_file);
+    writeString(detail);
+    fputc('}', trace_file);
+  }
+  fputc('}', trace_file);
+}
+
+
+void bt::traceCounter(const char *name, long value) {
+  if (!tracing())
+    return;
+
+  beginEvent();
+  fprintf(trace_file, "{\"ph\":\"C\",\"pid\":%ld,\"tid\":%ld,\"ts\":%lld,"
+          "\"name\":", trace_pid, trace_pid, traceTime());
+  writeString(name);
+  fprintf(trace_file, ",\"args\":{\"value\":%ld}}", value);
+}
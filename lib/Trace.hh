@@ -0,0 +1,86 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// Trace.hh for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __Trace_hh
+#define   __Trace_hh
+
+#include "Util.hh"
+
+namespace bt {
+
+  /*
+    A trace records spans of time and counter values in the Chrome
+    trace event format, which can be loaded into chrome://tracing or
+    Perfetto.  Tracing must only be used from the main thread.  While
+    no trace is running, spans and counters only test a flag.
+  */
+
+  // set while a trace is running, use tracing() instead
+  extern bool trace_enabled;
+
+  inline bool tracing(void)
+  { return trace_enabled; }
+
+  /*
+    Starts writing a trace to the specified file, replacing the
+    current trace if there is one.  Returns false if the file could
+    not be opened.
+  */
+  bool startTrace(const std::string &filename);
+
+  /*
+    Finishes and closes the current trace, if there is one.
+  */
+  void stopTrace(void);
+
+  // records the value of a counter, if a trace is running
+  void traceCounter(const char *name, long value);
+
+  // used by TraceSpan
+  long long traceTime(void);
+  void traceSpan(const char *name, const char *detail, long long start);
+
+  /*
+    Records the time between its construction and destruction as a
+    span named {name}, which must be a string literal.  The optional
+    {detail}, e.g. a file name, is added to the span's arguments and
+    must stay valid until the span ends.
+  */
+  class TraceSpan : public NoCopy {
+  public:
+    inline explicit TraceSpan(const char *name, const char *detail = 0)
+      : _name(name), _detail(detail), _start(tracing() ? traceTime() : -1ll)
+    { }
+    inline ~TraceSpan(void)
+    { if (_start >= 0ll && tracing()) traceSpan(_name, _detail, _start); }
+
+  private:
+    const char *_name;
+    const char *_detail;
+    long long _start;
+  };
+
+} // namespace bt
+
+#endif // __Trace_hh
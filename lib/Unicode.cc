@@ -25,11 +25,15 @@
 #include "Unicode.hh"
 
 #include <algorithm>
+#include <map>
 
+#include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <iconv.h>
 #include <locale.h>
 #include <cstdio>
+#include <cstring>
 
 #ifdef HAVE_NL_LANGINFO
 #  include <langinfo.h>
@@ -40,6 +44,143 @@ namespace bt {
 
   static const iconv_t invalid = reinterpret_cast<iconv_t>(-1);
   static std::string codeset;
+  // the locale codeset is UTF-8, or at least a superset of ASCII
+  static bool utf8_locale = false;
+  static bool ascii_locale = false;
+
+  static bool isUtf8Codeset(const std::string &name) {
+    std::string x;
+    for (std::string::const_iterator it = name.begin(); it != name.end(); ++it) {
+      if (*it != '-' && *it != '_')
+        x += static_cast<char>(tolower(*it));
+    }
+    return x == "utf8";
+  }
+
+  static bool isAsciiCodeset(const std::string &name) {
+    static const char * const prefixes[] = {
+      "ANSI_X3.4-1968", "ASCII", "US-ASCII", "ISO-8859-", "ISO8859-",
+      "KOI8-", "CP125", "EUC-", "GB2312", "GBK", "GB18030", 0
+    };
+    for (int x = 0; prefixes[x]; ++x) {
+      if (name.compare(0, strlen(prefixes[x]), prefixes[x]) == 0)
+        return true;
+    }
+    return false;
+  }
+
+  template <typename _String>
+  static bool isAscii(const _String &string) {
+    typename _String::const_iterator it = string.begin();
+    const typename _String::const_iterator end = string.end();
+    for (; it != end; ++it) {
+      if (static_cast<Uchar>(*it) >= 0x80u)
+        return false;
+    }
+    return true;
+  }
+
+  /*
+    Hand written UTF-8 <-> UTF-32 conversion, which is much faster
+    than going through iconv.  Malformed sequences, surrogates and
+    characters outside the Unicode range are skipped.
+  */
+  static void utf8ToUtf32(const unsigned char *p,
+                          const unsigned char * const end, ustring &out) {
+    while (p != end) {
+      const unsigned int c = *p;
+      if (c < 0x80u) {
+        out += c;
+        ++p;
+        continue;
+      }
+
+      unsigned int n, u, min;
+      if ((c & 0xe0u) == 0xc0u) {
+        n = 1u; u = c & 0x1fu; min = 0x80u;
+      } else if ((c & 0xf0u) == 0xe0u) {
+        n = 2u; u = c & 0x0fu; min = 0x800u;
+      } else if ((c & 0xf8u) == 0xf0u) {
+        n = 3u; u = c & 0x07u; min = 0x10000u;
+      } else {
+        ++p; // invalid lead byte
+        continue;
+      }
+
+      unsigned int i = 1u;
+      for (; i <= n && p + i != end && (p[i] & 0xc0u) == 0x80u; ++i)
+        u = (u << 6) | (p[i] & 0x3fu);
+      if (i <= n) {
+        p += i; // truncated sequence
+        continue;
+      }
+      p += i;
+
+      if (u >= min && u <= 0x10ffffu && (u < 0xd800u || u > 0xdfffu))
+        out += u;
+    }
+  }
+
+  static void utf8ToUtf32(const std::string &in, ustring &out) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(in.data());
+    utf8ToUtf32(p, p + in.size(), out);
+  }
+
+  // returns the number of characters converted
+  static std::string::size_type utf32ToUtf8(const ustring &in,
+                                            std::string &out) {
+    out.reserve(in.size());
+    std::string::size_type count = in.size();
+    ustring::const_iterator it = in.begin();
+    const ustring::const_iterator end = in.end();
+    for (; it != end; ++it) {
+      const Uchar u = *it;
+      if (u < 0x80u) {
+        out += static_cast<char>(u);
+      } else if (u < 0x800u) {
+        out += static_cast<char>(0xc0u | (u >> 6));
+        out += static_cast<char>(0x80u | (u & 0x3fu));
+      } else if (u < 0x10000u) {
+        if (u >= 0xd800u && u <= 0xdfffu) {
+          --count;
+          continue;
+        }
+        out += static_cast<char>(0xe0u | (u >> 12));
+        out += static_cast<char>(0x80u | ((u >> 6) & 0x3fu));
+        out += static_cast<char>(0x80u | (u & 0x3fu));
+      } else if (u <= 0x10ffffu) {
+        out += static_cast<char>(0xf0u | (u >> 18));
+        out += static_cast<char>(0x80u | ((u >> 12) & 0x3fu));
+        out += static_cast<char>(0x80u | ((u >> 6) & 0x3fu));
+        out += static_cast<char>(0x80u | (u & 0x3fu));
+      } else {
+        --count;
+      }
+    }
+    return count;
+  }
+
+  /*
+    Returns a conversion descriptor for the specified codesets.
+    Descriptors are opened once and kept for the life of the process.
+  */
+  static iconv_t descriptor(const char *target, const char *source) {
+    typedef std::map<std::pair<std::string, std::string>, iconv_t> Cache;
+    static Cache cache;
+
+    const Cache::key_type key(target, source);
+    Cache::iterator it = cache.find(key);
+    if (it != cache.end()) {
+      // reset the conversion state
+      if (it->second != invalid)
+        iconv(it->second, 0, 0, 0, 0);
+      return it->second;
+    }
+
+    iconv_t cd = iconv_open(target, source);
+    cache.insert(Cache::value_type(key, cd));
+    return cd;
+  }
 
   static unsigned int byte_swap(unsigned int c) {
     wchar_t ret;
@@ -79,7 +220,7 @@ namespace bt {
   template <typename _Source, typename _Target>
   static void convert(const char *target, const char *source,
                       const _Source &in, _Target &out) {
-    iconv_t cd = iconv_open(target, source);
+    iconv_t cd = descriptor(target, source);
     if (cd == invalid)
       return;
 
@@ -129,14 +270,12 @@ namespace bt {
         default:
           perror("iconv");
           out = _Target();
-          iconv_close(cd);
           return;
         }
       }
     } while (in_bytes != 0);
 
     out.resize((out_size - out_bytes) / sizeof(typename _Target::value_type));
-    iconv_close(cd);
   }
 
 } // namespace bt
@@ -178,16 +317,15 @@ bool bt::hasUnicode() {
   static const int conversions_count = 4;
 
   for (int x = 0; x < conversions_count; ++x) {
-    iconv_t cd = iconv_open(conversions[x].to, conversions[x].from);
-
-    if (cd == invalid) {
+    if (descriptor(conversions[x].to, conversions[x].from) == invalid) {
       has_unicode = false;
       break;
     }
-
-    iconv_close(cd);
   }
 
+  utf8_locale = isUtf8Codeset(codeset);
+  ascii_locale = utf8_locale || isAsciiCodeset(codeset);
+
   done = true;
   return has_unicode;
 }
@@ -200,6 +338,13 @@ bt::ustring bt::toUnicode(const std::string &string) {
     std::copy(string.begin(), string.end(), ret.begin());
     return ret;
   }
+  if (utf8_locale) {
+    ret.reserve(string.size());
+    utf8ToUtf32(string, ret);
+    return ret;
+  }
+  if (ascii_locale && isAscii(string))
+    return ustring(string.begin(), string.end());
   ret.reserve(string.size());
   convert("UTF-32", codeset.c_str(), string, ret);
   return native_endian(ret);
@@ -213,17 +358,28 @@ std::string bt::toLocale(const bt::ustring &string) {
     std::copy(string.begin(), string.end(), ret.begin());
     return ret;
   }
+  if (utf8_locale) {
+    utf32ToUtf8(string, ret);
+    return ret;
+  }
+  if (ascii_locale && isAscii(string))
+    return std::string(string.begin(), string.end());
   ret.reserve(string.size());
   convert(codeset.c_str(), "UTF-32", add_bom(string), ret);
   return ret;
 }
 
+std::string bt::toLocale(const bt::Utf8String &string) {
+  if (hasUnicode() && utf8_locale)
+    return string.utf8();
+  return toLocale(string.unicode());
+}
+
 std::string bt::toUtf8(const bt::ustring &utf32) {
   std::string ret;
   if (!hasUnicode())
     return ret;
-  ret.reserve(utf32.size());
-  convert("UTF-8", "UTF-32", add_bom(utf32), ret);
+  utf32ToUtf8(utf32, ret);
   return ret;
 }
 
@@ -232,6 +388,54 @@ bt::ustring bt::toUtf32(const std::string &utf8) {
   if (!hasUnicode())
     return ret;
   ret.reserve(utf8.size());
-  convert("UTF-32", "UTF-8", utf8, ret);
-  return native_endian(ret);
+  utf8ToUtf32(utf8, ret);
+  return ret;
+}
+
+bt::Utf8String::Utf8String(const bt::ustring &string)
+{ operator=(string); }
+
+bt::Utf8String &bt::Utf8String::operator=(const bt::ustring &string) {
+  std::string utf8;
+  _length = utf32ToUtf8(string, utf8);
+  // copying drops the spare capacity left by the conversion
+  std::string(utf8).swap(_utf8);
+  return *this;
+}
+
+bt::ustring bt::Utf8String::unicode(void) const {
+  ustring ret;
+  ret.reserve(_length);
+  utf8ToUtf32(_utf8, ret);
+  return ret;
+}
+
+bt::ustring bt::Utf8String::unicode(std::string::size_type pos,
+                                    std::string::size_type n) const {
+  assert(pos <= _length && n <= _length - pos);
+  // _utf8 is well formed, so each byte that is not a continuation byte
+  // starts a character
+  const unsigned char *p =
+    reinterpret_cast<const unsigned char *>(_utf8.data());
+  const unsigned char * const end = p + _utf8.size();
+  for (; pos > 0; --pos)
+    while (++p != end && (*p & 0xc0u) == 0x80u)
+      ;
+  const unsigned char *q = p;
+  for (std::string::size_type i = n; i > 0; --i)
+    while (++q != end && (*q & 0xc0u) == 0x80u)
+      ;
+
+  ustring ret;
+  ret.reserve(n);
+  utf8ToUtf32(p, q, ret);
+  return ret;
+}
+
+bool bt::Utf8String::operator==(const bt::ustring &string) const {
+  if (string.length() != _length)
+    return false;
+  std::string utf8;
+  utf32ToUtf8(string, utf8);
+  return utf8 == _utf8;
 }
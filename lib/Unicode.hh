@@ -66,6 +66,55 @@ namespace bt
    */
   ustring toUtf32(const std::string &utf8);
 
+  /*
+   * Compact storage for Unicode text that is kept for a long time,
+   * like window titles and menu labels.  The text is stored as UTF-8
+   * along with its length in characters.  textRect() and drawText()
+   * take it as is, unicode() converts it back to UTF-32.
+   */
+  class Utf8String {
+  public:
+    inline Utf8String(void)
+      : _length(0)
+    { }
+    Utf8String(const ustring &string);
+
+    Utf8String &operator=(const ustring &string);
+
+    inline bool empty(void) const
+    { return _length == 0; }
+    inline std::string::size_type length(void) const
+    { return _length; }
+    inline const std::string &utf8(void) const
+    { return _utf8; }
+
+    ustring unicode(void) const;
+    /*
+     * Returns n characters as UTF-32, starting with the character at
+     * pos.
+     */
+    ustring unicode(std::string::size_type pos,
+                    std::string::size_type n) const;
+
+    inline bool operator==(const Utf8String &other) const
+    { return _utf8 == other._utf8; }
+    inline bool operator!=(const Utf8String &other) const
+    { return !operator==(other); }
+    bool operator==(const ustring &string) const;
+    inline bool operator!=(const ustring &string) const
+    { return !operator==(string); }
+
+  private:
+    std::string _utf8;
+    std::string::size_type _length;
+  };
+
+  /*
+   * Converts Utf8String to multibyte locale-encoded string.  No
+   * conversion is done in a UTF-8 locale.
+   */
+  std::string toLocale(const Utf8String &string);
+
 } // namespace bt
 
 /*
@@ -37,6 +37,7 @@
 #include <assert.h>
 #include <cctype>
 #include <errno.h>
+#include <signal.h>
 #if defined(__EMX__)
 #  include <process.h>
 #endif // __EMX__
@@ -147,6 +148,10 @@ void bt::bexec(const std::string& command, const std::string& displaystring) {
 #ifndef __QNXTO__ // apparently, setsid interferes with signals on QNX
     setsid();
 #endif
+    // the event loop may block the signals it reads from a signalfd
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
     int ret = putenv(const_cast<char *>(displaystring.c_str()));
     assert(ret != -1);
     std::string cmd = "exec ";
@@ -0,0 +1,157 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// XIDTable.hh for Blackbox - An X11 Window Manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+#ifndef   __XIDTable_hh
+#define   __XIDTable_hh
+
+#include "Util.hh"
+
+#include <X11/X.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace bt {
+
+  /*
+    A hash table keyed by XID, stored in a single flat array with
+    linear probing.  Lookups touch one or two cache lines instead of
+    walking a tree.  None can not be used as a key, since it marks
+    empty slots: insert() refuses it, and nothing is found for it.
+  */
+  template <typename T>
+  class XIDTable : public NoCopy {
+  public:
+    inline XIDTable(void)
+      : count(0u)
+    { }
+
+    inline size_t size(void) const
+    { return count; }
+    inline bool empty(void) const
+    { return count == 0u; }
+
+    // returns the value stored for {key}, or zero if there is none
+    inline T *find(XID key) {
+      const size_t i = locate(key);
+      return (i == npos) ? 0 : &entries[i].value;
+    }
+    inline const T *find(XID key) const {
+      const size_t i = locate(key);
+      return (i == npos) ? 0 : &entries[i].value;
+    }
+
+    /*
+      Stores {value} for {key}.  Like std::map::insert(), an existing
+      value is not replaced; returns false in that case, and when
+      {key} is None.
+    */
+    bool insert(XID key, const T &value) {
+      if (key == None)
+        return false;
+      if ((count + 1u) * 2u > entries.size())
+        grow();
+      size_t i = slot(key);
+      for (; entries[i].key != None; i = (i + 1) & mask()) {
+        if (entries[i].key == key)
+          return false;
+      }
+      entries[i].key = key;
+      entries[i].value = value;
+      ++count;
+      return true;
+    }
+
+    // removes the value stored for {key}, if any
+    void erase(XID key) {
+      size_t hole = locate(key);
+      if (hole == npos)
+        return;
+
+      /*
+        shift the following entries of the probe sequence back into
+        the hole, so that no tombstones are needed
+      */
+      for (size_t i = (hole + 1) & mask();
+           entries[i].key != None; i = (i + 1) & mask()) {
+        const size_t home = slot(entries[i].key);
+        if (((i - home) & mask()) >= ((i - hole) & mask())) {
+          entries[hole] = entries[i];
+          hole = i;
+        }
+      }
+      entries[hole] = Entry();
+      --count;
+    }
+
+  private:
+    struct Entry {
+      XID key;
+      T value;
+
+      inline Entry(void)
+        : key(None), value()
+      { }
+    };
+
+    static const size_t npos = ~static_cast<size_t>(0);
+
+    inline size_t mask(void) const
+    { return entries.size() - 1u; }
+
+    // Fibonacci hashing spreads the sequential resource ids of a client
+    inline size_t slot(XID key) const {
+      const unsigned long long hash = key * 0x9e3779b97f4a7c15ull;
+      return static_cast<size_t>(hash >> 32) & mask();
+    }
+
+    size_t locate(XID key) const {
+      // None would match an empty slot
+      if (count == 0u || key == None)
+        return npos;
+      for (size_t i = slot(key); ; i = (i + 1) & mask()) {
+        if (entries[i].key == key)
+          return i;
+        if (entries[i].key == None)
+          return npos;
+      }
+    }
+
+    void grow(void) {
+      std::vector<Entry> old(std::max<size_t>(entries.size() * 2u, 16u));
+      old.swap(entries);
+      count = 0u;
+      for (size_t i = 0; i < old.size(); ++i) {
+        if (old[i].key != None)
+          insert(old[i].key, old[i].value);
+      }
+    }
+
+    std::vector<Entry> entries;
+    size_t count;
+  };
+
+} // namespace bt
+
+#endif // __XIDTable_hh
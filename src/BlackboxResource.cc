@@ -26,13 +26,16 @@
 
 #include "blackbox.hh"
 
+#include <EventProfiler.hh>
 #include <Image.hh>
 #include <Resource.hh>
+#include <Trace.hh>
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
 
+#include <cstdio>
 #include <cstring>
 
 
@@ -71,6 +74,28 @@ void BlackboxResource::load(Blackbox& blackbox) {
                                    "Session.DoubleClickInterval",
                                    250l);
 
+  // the stall threshold implies profiling, since the profiler
+  // measures the events
+  const long stall_threshold = res.read("session.stallThreshold",
+                                        "Session.StallThreshold",
+                                        0l);
+  blackbox.setEventProfiling(res.read("session.eventProfiling",
+                                      "Session.EventProfiling",
+                                      false)
+                             || stall_threshold > 0l);
+  if (blackbox.eventProfiler())
+    blackbox.eventProfiler()->setStallThreshold(stall_threshold);
+
+  // a running trace is kept when the configuration is reread
+  const std::string trace_file =
+    bt::expandTilde(res.read("session.traceFile",
+                             "Session.TraceFile",
+                             ""));
+  if (trace_file.empty())
+    bt::stopTrace();
+  else if (! bt::tracing() && ! bt::startTrace(trace_file))
+    perror(trace_file.c_str());
+
   auto_raise_delay.tv_usec = res.read("session.autoRaiseDelay",
                                       "Session.AutoRaiseDelay",
                                       400l);
@@ -254,6 +279,12 @@ void BlackboxResource::save(Blackbox& blackbox) {
   res.write("session.autoRaiseDelay", ((auto_raise_delay.tv_sec * 1000ul) +
                                        (auto_raise_delay.tv_usec / 1000ul)));
 
+  res.write("session.eventProfiling", blackbox.eventProfiler() != 0);
+
+  res.write("session.stallThreshold",
+            (blackbox.eventProfiler()
+             ? blackbox.eventProfiler()->stallThreshold() : 0l));
+
   std::string str;
   switch (bt::Image::ditherMode()) {
   case bt::OrderedDither:        str = "OrderedDither";        break;
@@ -22,9 +22,12 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 // DEALINGS IN THE SOFTWARE.
 
+#include "gettext.h"
 #include "Rootmenu.hh"
 #include "Screen.hh"
 
+#include <EventProfiler.hh>
+#include <PixmapCache.hh>
 #include <Unicode.hh>
 
 
@@ -71,6 +74,27 @@ void Rootmenu::itemClicked(unsigned int id, unsigned int) {
     _bscreen->blackbox()->quit();
     break;
 
+  case BScreen::DumpPixmapCache:
+    if (! it->second.string.empty()
+        && ! bt::PixmapCache::dumpStatistics(it->second.string))
+      perror(it->second.string.c_str());
+    break;
+
+  case BScreen::DumpEventProfile: {
+    const Blackbox * const blackbox = _bscreen->blackbox();
+    const bt::EventProfiler * const profiler = blackbox->eventProfiler();
+    if (! profiler) {
+      fprintf(stderr, gettext("%s: [eventstats] error, event profiling is "
+                              "disabled, see session.eventProfiling\n"),
+              blackbox->applicationName().c_str());
+    } else if (! it->second.string.empty()
+               && ! profiler->dump(it->second.string, blackbox->wakeups(),
+                                   blackbox->timerWakeups())) {
+      perror(it->second.string.c_str());
+    }
+    break;
+  }
+
   case BScreen::SetStyle:
     if (! it->second.string.empty())
       _bscreen->blackbox()->resource().saveStyleFilename(it->second.string);
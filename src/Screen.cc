@@ -41,6 +41,7 @@
 
 #include <Pen.hh>
 #include <PixmapCache.hh>
+#include <Trace.hh>
 #include <Unicode.hh>
 
 #include <X11/Xutil.h>
@@ -439,8 +440,10 @@ BScreen::~BScreen(void) {
 
   bt::PixmapCache::release(geom_pixmap);
 
-  if (geom_window != None)
+  if (geom_window != None) {
+    bt::Pen::clearCache(geom_window);
     XDestroyWindow(_blackbox->XDisplay(), geom_window);
+  }
   if (empty_window != None)
     XDestroyWindow(_blackbox->XDisplay(), empty_window);
 
@@ -601,6 +604,7 @@ void BScreen::removeLastWorkspace(void) {
 
 
 void BScreen::setCurrentWorkspace(unsigned int id) {
+  bt::TraceSpan span("BScreen::setCurrentWorkspace");
   if (id == current_workspace)
     return;
 
@@ -736,6 +740,7 @@ static StackingList::iterator raiseWindow(StackingList &stackingList,
                                           StackEntity *entity);
 
 void BScreen::manageWindow(Window w) {
+  bt::TraceSpan span("BScreen::manageWindow");
   XWMHints *wmhints = XGetWMHints(_blackbox->XDisplay(), w);
   bool slit_client = (wmhints && (wmhints->flags & StateHint) &&
                       wmhints->initial_state == WithdrawnState);
@@ -1096,6 +1101,7 @@ StackingList::iterator raiseWindow(StackingList &stackingList,
   the X server.  The EWMH stacking hint is also updated.
  */
 void BScreen::raiseWindow(StackEntity *entity) {
+  bt::TraceSpan span("BScreen::raiseWindow");
   StackingList::iterator top = ::raiseWindow(_stackingList, entity),
                          end = _stackingList.end();
   if (top == end) {
@@ -1763,6 +1769,34 @@ bool BScreen::parseMenuFile(FILE *file, Rootmenu *menu) {
       break;
     }
 
+    case 1059: { // cachestats
+      if (! (*label && *command)) {
+        fprintf(stderr,
+                gettext("%s: [cachestats] error, no menu label and/or filename defined\n"),
+                _blackbox->applicationName().c_str());
+        continue;
+      }
+
+      std::string filename = bt::expandTilde(command);
+      menu->insertFunction(bt::toUnicode(label),
+                           BScreen::DumpPixmapCache, filename.c_str());
+      break;
+    }
+
+    case 1105: { // eventstats
+      if (! (*label && *command)) {
+        fprintf(stderr,
+                gettext("%s: [eventstats] error, no menu label and/or filename defined\n"),
+                _blackbox->applicationName().c_str());
+        continue;
+      }
+
+      std::string filename = bt::expandTilde(command);
+      menu->insertFunction(bt::toUnicode(label),
+                           BScreen::DumpEventProfile, filename.c_str());
+      break;
+    }
+
     case 995:    // stylesdir
     case 1113: { // stylesmenu
       bool newmenu = ((key == 1113) ? True : False);
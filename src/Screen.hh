@@ -118,7 +118,7 @@ private:
 
 public:
   enum { Restart = 1, RestartOther, Exit, Shutdown, Execute, Reconfigure,
-         SetStyle };
+         SetStyle, DumpPixmapCache, DumpEventProfile };
 
   BScreen(Blackbox *bb, unsigned int scrn);
   ~BScreen(void);
@@ -30,6 +30,7 @@
 
 #include <Menu.hh>
 #include <Resource.hh>
+#include <Trace.hh>
 
 #include <assert.h>
 
@@ -243,6 +244,7 @@ void ScreenResource::load(bt::Resource& res, unsigned int screen) {
 
 
 void ScreenResource::loadStyle(BScreen* screen, const std::string& style) {
+  bt::TraceSpan span("ScreenResource::loadStyle", style.c_str());
   const bt::Display& display = screen->blackbox()->display();
   unsigned int screen_num = screen->screenNumber();
 
@@ -251,6 +253,14 @@ void ScreenResource::loadStyle(BScreen* screen, const std::string& style) {
   if (!res.valid())
     res.load(DEFAULTSTYLE);
 
+  // match the fonts in the background while the textures are loaded
+  bt::Font::prefetch(res.read("menu.title.font", "Menu.Title.Font"),
+                     screen_num);
+  bt::Font::prefetch(res.read("menu.frame.font", "Menu.Frame.Font"),
+                     screen_num);
+  bt::Font::prefetch(res.read("window.font", "Window.Font"), screen_num);
+  bt::Font::prefetch(res.read("toolbar.font", "Toolbar.Font"), screen_num);
+
   // load menu style
   bt::MenuStyle::get(*screen->blackbox(), screen_num)->load(res);
 
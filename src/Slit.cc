@@ -52,6 +52,7 @@ Slit::Slit(BScreen *scr) {
 
   timer = new bt::Timer(blackbox, this);
   timer->setTimeout(blackbox->resource().autoRaiseDelay());
+  timer->setSlack(50l);
 
   XSetWindowAttributes attrib;
   unsigned long create_mask = CWColormap | CWEventMask;
@@ -73,8 +73,12 @@ Toolbar::Toolbar(BScreen *scrn) {
     clock_timer_resolution = 3600;
   }
 
+  // let the clock tick up to 1% of its resolution late
+  clock_timer->setSlack(clock_timer_resolution * 10l);
+
   hide_timer = new bt::Timer(blackbox, this);
   hide_timer->setTimeout(blackbox->resource().autoRaiseDelay());
+  hide_timer->setSlack(50l);
 
   setLayer(options.always_on_top
            ? StackingList::LayerAbove
@@ -186,6 +190,10 @@ Toolbar::~Toolbar(void) {
   blackbox->removeEventHandler(frame.pwbutton);
   blackbox->removeEventHandler(frame.nwbutton);
 
+  bt::Pen::clearCache(frame.workspace_label);
+  bt::Pen::clearCache(frame.window_label);
+  bt::Pen::clearCache(frame.clock);
+
   // all children windows are destroyed by this call as well
   XDestroyWindow(display, frame.window);
 
@@ -491,7 +499,8 @@ void Toolbar::redrawWindowLabel(void) {
   bt::Pen pen(_screen->screenNumber(), style.wlabel_text);
   bt::drawText(style.font, pen, frame.window_label, u,
                style.alignment,
-               bt::ellideText(foc->title(), u.width(), bt::toUnicode("..."),
+               bt::ellideText(foc->title().unicode(), u.width(),
+                              bt::toUnicode("..."),
                               _screen->screenNumber(), style.font));
 }
 
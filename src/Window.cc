@@ -36,6 +36,8 @@
 
 #include <Pen.hh>
 #include <PixmapCache.hh>
+#include <PropertyBatch.hh>
+#include <Trace.hh>
 #include <Unicode.hh>
 
 #include <X11/Xatom.h>
@@ -526,13 +528,49 @@ static bt::Rect restoreGravity(const bt::Rect &rect,
 }
 
 
+/*
+ * The length used to read variable length properties, in 32-bit units.
+ * Reading the whole property at once avoids the extra round trip that
+ * XGetTextProperty() and friends make to find the length first.
+ */
+static const long max_property_length = 0x1fffffffl;
+
+
+/*
+ * Reads a text property like XGetTextProperty(), but through
+ * bt::getWindowProperty() so that it can be answered from a
+ * bt::PropertyBatch.
+ */
+static bool readTextProperty(Blackbox *blackbox, Window window,
+                             Atom property, XTextProperty &text_prop) {
+  Atom type;
+  int format;
+  unsigned long nitems, bytes_after;
+  unsigned char *data = 0;
+  if (bt::getWindowProperty(blackbox->XDisplay(), window, property,
+                            0l, max_property_length, AnyPropertyType,
+                            &type, &format, &nitems, &bytes_after,
+                            &data) != Success
+      || type == None) {
+    if (data) XFree(data);
+    return false;
+  }
+
+  text_prop.value = data;
+  text_prop.encoding = type;
+  text_prop.format = format;
+  text_prop.nitems = nitems;
+  return true;
+}
+
+
 static bt::ustring readWMName(Blackbox *blackbox, Window window) {
   bt::ustring name;
 
   if (!blackbox->ewmh().readWMName(window, name) || name.empty()) {
     XTextProperty text_prop;
 
-    if (XGetWMName(blackbox->XDisplay(), window, &text_prop)) {
+    if (readTextProperty(blackbox, window, XA_WM_NAME, text_prop)) {
       name = bt::toUnicode(bt::textPropertyToString(blackbox->XDisplay(),
                                                     text_prop));
       XFree((char *) text_prop.value);
@@ -552,7 +590,7 @@ static bt::ustring readWMIconName(Blackbox *blackbox, Window window) {
 
   if (!blackbox->ewmh().readWMIconName(window, name) || name.empty()) {
     XTextProperty text_prop;
-    if (XGetWMIconName(blackbox->XDisplay(), window, &text_prop)) {
+    if (readTextProperty(blackbox, window, XA_WM_ICON_NAME, text_prop)) {
       name = bt::toUnicode(bt::textPropertyToString(blackbox->XDisplay(),
                                                     text_prop));
       XFree((char *) text_prop.value);
@@ -704,12 +742,12 @@ static MotifHints readMotifWMHints(Blackbox *blackbox, Window window) {
   PropMotifhints *prop = 0;
   int format;
   unsigned long num, len;
-  int ret = XGetWindowProperty(blackbox->XDisplay(), window,
-                               blackbox->motifWmHintsAtom(), 0,
-                               PROP_MWM_HINTS_ELEMENTS, False,
-                               blackbox->motifWmHintsAtom(), &atom_return,
-                               &format, &num, &len,
-                               (unsigned char **) &prop);
+  int ret = bt::getWindowProperty(blackbox->XDisplay(), window,
+                                  blackbox->motifWmHintsAtom(), 0,
+                                  PROP_MWM_HINTS_ELEMENTS,
+                                  blackbox->motifWmHintsAtom(), &atom_return,
+                                  &format, &num, &len,
+                                  (unsigned char **) &prop);
 
   if (ret != Success || !prop || num != PROP_MWM_HINTS_ELEMENTS) {
     if (prop) XFree(prop);
@@ -790,19 +828,38 @@ static WMHints readWMHints(Blackbox *blackbox, Window window) {
   wmh.initial_state = NormalState;
   wmh.urgency = false;
 
-  XWMHints *wmhint = XGetWMHints(blackbox->XDisplay(), window);
-  if (!wmhint) return wmh;
-
-  if (wmhint->flags & InputHint)
-    wmh.accept_focus = (wmhint->input == True);
-  if (wmhint->flags & StateHint)
-    wmh.initial_state = wmhint->initial_state;
-  if (wmhint->flags & WindowGroupHint)
-    wmh.window_group = wmhint->window_group;
-  if (wmhint->flags & XUrgencyHint)
+  /*
+    the property is read directly instead of with XGetWMHints(), which
+    bypasses bt::PropertyBatch.  the layout is from the ICCCM: flags,
+    input, initial_state, icon_pixmap, icon_window, icon_x, icon_y,
+    icon_mask, window_group.  old clients omit window_group.
+  */
+  enum { WMHintsElements = 9 };
+  Atom type;
+  int format;
+  unsigned long nitems, bytes_after;
+  long *hints = 0;
+  if (bt::getWindowProperty(blackbox->XDisplay(), window, XA_WM_HINTS,
+                            0l, WMHintsElements, XA_WM_HINTS,
+                            &type, &format, &nitems, &bytes_after,
+                            (unsigned char **) &hints) != Success
+      || !hints || type != XA_WM_HINTS || format != 32
+      || nitems < WMHintsElements - 1) {
+    if (hints) XFree(hints);
+    return wmh;
+  }
+
+  const long flags = hints[0];
+  if (flags & InputHint)
+    wmh.accept_focus = (hints[1] != 0);
+  if (flags & StateHint)
+    wmh.initial_state = hints[2];
+  if ((flags & WindowGroupHint) && nitems >= WMHintsElements)
+    wmh.window_group = hints[8];
+  if (flags & XUrgencyHint)
     wmh.urgency = true;
 
-  XFree(wmhint);
+  XFree(hints);
 
   return wmh;
 }
@@ -833,10 +890,47 @@ static WMNormalHints readWMNormalHints(Blackbox *blackbox,
   wmnormal.max_width = rect.width();
   wmnormal.max_height = rect.height();
 
-  XSizeHints sizehint;
-  long unused;
-  if (! XGetWMNormalHints(blackbox->XDisplay(), window, &sizehint, &unused))
+  /*
+    the property is read directly instead of with XGetWMNormalHints(),
+    which bypasses bt::PropertyBatch.  the layout is from the ICCCM:
+    flags, 4 unused fields, min size, max size, resize increments,
+    min and max aspect, base size and gravity.  pre-ICCCM clients
+    omit the last 3 fields.
+  */
+  enum { OldSizeHintsElements = 15, SizeHintsElements = 18 };
+  Atom type;
+  int format;
+  unsigned long nitems, bytes_after;
+  long *data = 0;
+  if (bt::getWindowProperty(blackbox->XDisplay(), window,
+                            XA_WM_NORMAL_HINTS, 0l, SizeHintsElements,
+                            XA_WM_SIZE_HINTS, &type, &format, &nitems,
+                            &bytes_after, (unsigned char **) &data) != Success
+      || !data || type != XA_WM_SIZE_HINTS || format != 32
+      || nitems < OldSizeHintsElements) {
+    if (data) XFree(data);
     return wmnormal;
+  }
+
+  XSizeHints sizehint;
+  sizehint.flags = data[0] & (USPosition | USSize | PAllHints);
+  sizehint.min_width    = data[5];
+  sizehint.min_height   = data[6];
+  sizehint.max_width    = data[7];
+  sizehint.max_height   = data[8];
+  sizehint.width_inc    = data[9];
+  sizehint.height_inc   = data[10];
+  sizehint.min_aspect.x = data[11];
+  sizehint.min_aspect.y = data[12];
+  sizehint.max_aspect.x = data[13];
+  sizehint.max_aspect.y = data[14];
+  if (nitems >= SizeHintsElements) {
+    sizehint.flags |= data[0] & (PBaseSize | PWinGravity);
+    sizehint.base_width  = data[15];
+    sizehint.base_height = data[16];
+    sizehint.win_gravity = data[17];
+  }
+  XFree(data);
 
   wmnormal.flags = sizehint.flags;
 
@@ -904,20 +998,26 @@ static WMProtocols readWMProtocols(Blackbox *blackbox,
   protocols.wm_delete_window = false;
   protocols.wm_take_focus    = false;
 
-  Atom *proto;
-  int num_return = 0;
-
-  if (XGetWMProtocols(blackbox->XDisplay(), window,
-                      &proto, &num_return)) {
-    for (int i = 0; i < num_return; ++i) {
+  Atom type;
+  int format;
+  unsigned long num_return, bytes_after;
+  Atom *proto = 0;
+
+  if (bt::getWindowProperty(blackbox->XDisplay(), window,
+                            blackbox->wmProtocolsAtom(), 0l,
+                            max_property_length, XA_ATOM, &type, &format,
+                            &num_return, &bytes_after,
+                            (unsigned char **) &proto) == Success
+      && proto && type == XA_ATOM && format == 32) {
+    for (unsigned long i = 0; i < num_return; ++i) {
       if (proto[i] == blackbox->wmDeleteWindowAtom()) {
         protocols.wm_delete_window = true;
       } else if (proto[i] == blackbox->wmTakeFocusAtom()) {
         protocols.wm_take_focus = true;
       }
     }
-    XFree(proto);
   }
+  if (proto) XFree(proto);
 
   return protocols;
 }
@@ -938,13 +1038,23 @@ static Window readTransientInfo(Blackbox *blackbox,
                                 Window window,
                                 const bt::ScreenInfo &screenInfo,
                                 const WMHints &wmhints) {
-  Window trans_for = None;
-
-  if (!XGetTransientForHint(blackbox->XDisplay(), window, &trans_for)) {
+  Atom type;
+  int format;
+  unsigned long nitems, bytes_after;
+  Window *data = 0;
+  if (bt::getWindowProperty(blackbox->XDisplay(), window,
+                            XA_WM_TRANSIENT_FOR, 0l, 1l, XA_WINDOW,
+                            &type, &format, &nitems, &bytes_after,
+                            (unsigned char **) &data) != Success
+      || !data || type != XA_WINDOW || format != 32 || nitems < 1) {
     // WM_TRANSIENT_FOR hint not set
+    if (data) XFree(data);
     return 0;
   }
 
+  Window trans_for = data[0];
+  XFree(data);
+
   if (trans_for == window) {
     // wierd client... treat this window as a normal window
     return 0;
@@ -1007,6 +1117,8 @@ static void clearState(Blackbox *blackbox, Window window) {
  * Initializes the class with default values/the window's set initial values.
  */
 BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
+  bt::TraceSpan span("BlackboxWindow::BlackboxWindow");
+
   // fprintf(stderr, "BlackboxWindow size: %d bytes\n",
   //         sizeof(BlackboxWindow));
 
@@ -1092,6 +1204,33 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
 
   timer = new bt::Timer(blackbox, this);
   timer->setTimeout(blackbox->resource().autoRaiseDelay());
+  timer->setSlack(50l);
+
+  /*
+    read all of the client's properties with a single round trip.  the
+    server is grabbed, so the properties cannot change until the batch
+    is released below.
+  */
+  const bt::EWMH &ewmh = blackbox->ewmh();
+  bt::PropertyBatch properties(blackbox->display(), client.window);
+  properties.request(ewmh.wmName(), max_property_length);
+  properties.request(ewmh.wmIconName(), max_property_length);
+  properties.request(XA_WM_NAME, max_property_length);
+  properties.request(XA_WM_ICON_NAME, max_property_length);
+  properties.request(ewmh.wmWindowType(), max_property_length);
+  properties.request(ewmh.wmState(), max_property_length);
+  properties.request(ewmh.wmDesktop(), 1l);
+  properties.request(blackbox->motifWmHintsAtom(), 5l);
+  properties.request(XA_WM_HINTS, 9l);
+  properties.request(XA_WM_NORMAL_HINTS, 18l);
+  properties.request(blackbox->wmProtocolsAtom(), max_property_length);
+  properties.request(XA_WM_TRANSIENT_FOR, 1l);
+  properties.request(ewmh.wmStrutPartial(), 12l);
+  properties.request(ewmh.wmStrut(), 4l);
+  properties.request(ewmh.wmUserTimeWindow(), 1l);
+  properties.request(ewmh.wmUserTime(), 1l);
+  properties.request(ewmh.startupID(), max_property_length);
+  properties.fetch();
 
   client.title = ::readWMName(blackbox, client.window);
   client.icon_title = ::readWMIconName(blackbox, client.window);
@@ -1199,6 +1338,8 @@ BlackboxWindow::BlackboxWindow(Blackbox *b, Window w, BScreen *s) {
 
   blackbox->ewmh().readStartupID(client.window, client.startup_id);
 
+  properties.release();
+
   /*
     if we just managed the group leader for an existing group, move
     all group transients to this window
@@ -1653,6 +1794,7 @@ void BlackboxWindow::destroyTitlebar(void) {
   blackbox->removeEventHandler(frame.title);
   blackbox->removeEventHandler(frame.label);
 
+  bt::Pen::clearCache(frame.label);
   XDestroyWindow(blackbox->XDisplay(), frame.label);
   XDestroyWindow(blackbox->XDisplay(), frame.title);
   frame.title = frame.label = None;
@@ -1786,12 +1928,13 @@ void BlackboxWindow::positionButtons(bool redecorate_label) {
     }
 
     const bt::ustring ellided =
-      bt::ellideText(client.title, frame.label_w, bt::toUnicode("..."),
-                     _screen->screenNumber(), style.font);
+      bt::ellideText(client.title.unicode(), frame.label_w,
+                     bt::toUnicode("..."), _screen->screenNumber(),
+                     style.font);
 
-    if (ellided != client.visible_title) {
+    if (client.visible_title != ellided) {
       client.visible_title = ellided;
-      blackbox->ewmh().setWMVisibleName(client.window, client.visible_title);
+      blackbox->ewmh().setWMVisibleName(client.window, ellided);
     }
   } else {
     frame.label_w = 1;
@@ -2351,7 +2494,8 @@ void BlackboxWindow::show(void) {
   XTranslateCoordinates(blackbox->XDisplay(), client.window,
                         _screen->screenInfo().rootWindow(),
                         0, 0, &real_x, &real_y, &child);
-  fprintf(stderr, gettext("%s -- assumed: (%d, %d), real: (%d, %d)\n"), title().c_str(),
+  fprintf(stderr, gettext("%s -- assumed: (%d, %d), real: (%d, %d)\n"),
+          bt::toLocale(title()).c_str(),
           client.rect.left(), client.rect.top(), real_x, real_y);
   assert(client.rect.left() == real_x && client.rect.top() == real_y);
 #endif
@@ -3435,11 +3579,12 @@ void BlackboxWindow::propertyNotifyEvent(const XPropertyEvent * const event) {
   case XA_WM_NAME: {
     client.title = ::readWMName(blackbox, client.window);
 
-    client.visible_title =
-      bt::ellideText(client.title, frame.label_w, bt::toUnicode("..."),
-                     _screen->screenNumber(),
+    const bt::ustring ellided =
+      bt::ellideText(client.title.unicode(), frame.label_w,
+                     bt::toUnicode("..."), _screen->screenNumber(),
                      _screen->resource().windowStyle().font);
-    blackbox->ewmh().setWMVisibleName(client.window, client.visible_title);
+    client.visible_title = ellided;
+    blackbox->ewmh().setWMVisibleName(client.window, ellided);
 
     if (client.decorations & WindowDecorationTitlebar)
       redrawLabel();
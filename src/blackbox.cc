@@ -30,6 +30,7 @@
 
 #include <Pen.hh>
 #include <PixmapCache.hh>
+#include <Trace.hh>
 #include <Util.hh>
 
 extern "C" {
@@ -135,6 +136,8 @@ void Blackbox::shutdown(void) {
   XSync(XDisplay(), false);
 
   XUngrabServer();
+
+  bt::stopTrace();
 }
 
 
@@ -529,35 +532,58 @@ BScreen* Blackbox::screenNumber(unsigned int n) {
 
 
 BlackboxWindow *Blackbox::findWindow(Window window) const {
-  WindowLookup::const_iterator it = windowSearchList.find(window);
-  if (it != windowSearchList.end())
-    return it->second;
-  return 0;
+  const ClientRef * const ref = clientSearchList.find(window);
+  return ref ? ref->window : 0;
 }
 
 
-void Blackbox::insertWindow(Window window, BlackboxWindow *data)
-{ windowSearchList.insert(WindowLookupPair(window, data)); }
+void Blackbox::insertWindow(Window window, BlackboxWindow *data) {
+  ClientRef *ref = clientSearchList.find(window);
+  if (! ref) {
+    clientSearchList.insert(window, ClientRef());
+    ref = clientSearchList.find(window);
+  }
+  // like std::map::insert(), an existing entry is kept
+  if (! ref->window)
+    ref->window = data;
+}
 
 
-void Blackbox::removeWindow(Window window)
-{ windowSearchList.erase(window); }
+void Blackbox::removeWindow(Window window) {
+  ClientRef * const ref = clientSearchList.find(window);
+  if (! ref)
+    return;
+  ref->window = 0;
+  if (! ref->group)
+    clientSearchList.erase(window);
+}
 
 
 BWindowGroup *Blackbox::findWindowGroup(Window window) const {
-  GroupLookup::const_iterator it = groupSearchList.find(window);
-  if (it != groupSearchList.end())
-    return it->second;
-  return 0;
+  const ClientRef * const ref = clientSearchList.find(window);
+  return ref ? ref->group : 0;
 }
 
 
-void Blackbox::insertWindowGroup(Window window, BWindowGroup *data)
-{ groupSearchList.insert(GroupLookupPair(window, data)); }
+void Blackbox::insertWindowGroup(Window window, BWindowGroup *data) {
+  ClientRef *ref = clientSearchList.find(window);
+  if (! ref) {
+    clientSearchList.insert(window, ClientRef());
+    ref = clientSearchList.find(window);
+  }
+  if (! ref->group)
+    ref->group = data;
+}
 
 
-void Blackbox::removeWindowGroup(Window window)
-{ groupSearchList.erase(window); }
+void Blackbox::removeWindowGroup(Window window) {
+  ClientRef * const ref = clientSearchList.find(window);
+  if (! ref)
+    return;
+  ref->group = 0;
+  if (! ref->window)
+    clientSearchList.erase(window);
+}
 
 
 void Blackbox::setFocusedWindow(BlackboxWindow *win) {
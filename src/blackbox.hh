@@ -27,6 +27,7 @@
 
 #include <Application.hh>
 #include <Util.hh>
+#include <XIDTable.hh>
 
 extern "C" {
 #include <X11/Xatom.h>
@@ -61,13 +62,20 @@ private:
   size_t screen_list_count;
   BScreen *active_screen;
 
-  typedef std::map<Window, BlackboxWindow*> WindowLookup;
-  typedef WindowLookup::value_type WindowLookupPair;
-  WindowLookup windowSearchList;
-
-  typedef std::map<Window, BWindowGroup*> GroupLookup;
-  typedef GroupLookup::value_type GroupLookupPair;
-  GroupLookup groupSearchList;
+  /*
+    the window and the window group that a Window belongs to, either
+    of which may be zero.  a group leader can also be a managed client
+    window, so both are kept in one entry.
+  */
+  struct ClientRef {
+    BlackboxWindow *window;
+    BWindowGroup *group;
+    inline ClientRef(void)
+      : window(0), group(0)
+    { }
+  };
+  typedef bt::XIDTable<ClientRef> ClientLookup;
+  ClientLookup clientSearchList;
 
   bt::EWMH* _ewmh;
 
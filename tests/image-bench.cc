@@ -0,0 +1,90 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// image-bench.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Measures bt::Image::render() into memory for each gradient type, at
+ * the size of a title bar and of a root window background.
+ */
+
+#include "Color.hh"
+#include "Image.hh"
+#include "Texture.hh"
+#include "Timer.hh"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <vector>
+
+
+int main(int, char **) {
+  static const struct {
+    unsigned long type;
+    const char *name;
+  } types[] = {
+    { bt::Texture::Horizontal,    "horizontal" },
+    { bt::Texture::Vertical,      "vertical" },
+    { bt::Texture::Diagonal,      "diagonal" },
+    { bt::Texture::CrossDiagonal, "crossdiagonal" },
+    { bt::Texture::Rectangle,     "rectangle" },
+    { bt::Texture::Pyramid,       "pyramid" },
+    { bt::Texture::PipeCross,     "pipecross" },
+    { bt::Texture::Elliptic,      "elliptic" },
+    { bt::Texture::SplitVertical, "splitvertical" }
+  };
+  static const unsigned int sizes[][2] = { { 400, 20 }, { 1920, 1080 } };
+
+  bt::Image::setDitherMode(bt::NoDither);
+  const bt::ImageFormat format;
+
+  printf("%-14s %12s %12s\n", "microseconds", "400x20", "1920x1080");
+  for (unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+    bt::Texture texture;
+    texture.setTexture(bt::Texture::Gradient | bt::Texture::Raised
+                       | types[t].type);
+    texture.setColor1(bt::Color(0x20, 0x4a, 0x87));
+    texture.setColor2(bt::Color(0xd3, 0xd7, 0xcf));
+
+    printf("%-14s", types[t].name);
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+      const unsigned int width = sizes[s][0], height = sizes[s][1];
+      std::vector<unsigned char> pixels(width * height * 4u);
+
+      // about the same total number of pixels for each size
+      const unsigned int runs =
+        std::max(4000000u / (width * height), 1u) * 10u;
+      const bt::Nanoseconds start = bt::monotonicTime();
+      for (unsigned int i = 0; i < runs; ++i) {
+        bt::Image image(width, height);
+        if (!image.render(texture, format, &pixels[0]))
+          return EXIT_FAILURE;
+      }
+      const bt::Nanoseconds elapsed = bt::monotonicTime() - start;
+      printf(" %12.1f", (elapsed / 1000.0) / runs);
+    }
+    printf("\n");
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,173 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// image-test.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Renders every gradient type, bevel, interlacing and dither mode with
+ * bt::Image::render() into memory and compares checksums of the results
+ * with the ones recorded below.  The images are rendered with one and
+ * with several threads, which must give the same result.
+ *
+ * After an intended change to the rendering, run with -g to print a
+ * new image-test.golden.
+ */
+
+#include "Color.hh"
+#include "Image.hh"
+#include "Texture.hh"
+#include "Thread.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+
+
+static const unsigned long types[] = {
+  bt::Texture::Horizontal,
+  bt::Texture::Vertical,
+  bt::Texture::Diagonal,
+  bt::Texture::CrossDiagonal,
+  bt::Texture::Rectangle,
+  bt::Texture::Pyramid,
+  bt::Texture::PipeCross,
+  bt::Texture::Elliptic,
+  bt::Texture::SplitVertical
+};
+static const unsigned int TypeCount = sizeof(types) / sizeof(types[0]);
+
+static const unsigned long bevels[] = {
+  bt::Texture::Flat,
+  bt::Texture::Raised,
+  bt::Texture::Sunken,
+  bt::Texture::Raised | bt::Texture::Border
+};
+static const unsigned int BevelCount = sizeof(bevels) / sizeof(bevels[0]);
+
+static const bt::DitherMode dithers[] = {
+  bt::NoDither,
+  bt::OrderedDither,
+  bt::FloydSteinbergDither
+};
+static const unsigned int DitherCount = sizeof(dithers) / sizeof(dithers[0]);
+
+// the second size is large enough to be rendered in bands
+static const unsigned int sizes[][2] = { { 37, 23 }, { 512, 160 } };
+static const unsigned int SizeCount = sizeof(sizes) / sizeof(sizes[0]);
+
+
+// FNV-1a
+static unsigned long checksum(unsigned long hash,
+                              const unsigned char *data, size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= data[i];
+    hash = (hash * 16777619ul) & 0xfffffffful;
+  }
+  return hash;
+}
+
+
+static unsigned long render(unsigned long texture_type,
+                            bt::DitherMode dither) {
+  bt::Texture texture;
+  texture.setTexture(texture_type);
+  texture.setColor1(bt::Color(0x20, 0x4a, 0x87));
+  texture.setColor2(bt::Color(0xd3, 0xd7, 0xcf));
+  texture.setBorderColor(bt::Color(0x00, 0x00, 0x00));
+  texture.setBorderWidth(2u);
+  bt::Image::setDitherMode(dither);
+
+  // 16 bits per pixel so that the dithering shows, with a fixed byte
+  // order so that the checksums do not depend on the host
+  bt::ImageFormat format;
+  format.bits_per_pixel = 16u;
+  format.msb_first = false;
+  format.red_mask = 0xf800ul;
+  format.green_mask = 0x07e0ul;
+  format.blue_mask = 0x001ful;
+
+  unsigned long hash = 2166136261ul;
+  for (unsigned int s = 0; s < SizeCount; ++s) {
+    const unsigned int width = sizes[s][0], height = sizes[s][1];
+    std::vector<unsigned char> pixels(width * height * 2u);
+    bt::Image image(width, height);
+    if (!image.render(texture, format, &pixels[0]))
+      return 0ul;
+    hash = checksum(hash, &pixels[0], pixels.size());
+  }
+  return hash;
+}
+
+
+// recorded with -g, in the order of the loops in main()
+static const unsigned long golden[] = {
+#include "image-test.golden"
+};
+
+
+int main(int argc, char **argv) {
+  const bool generate = (argc > 1 && strcmp(argv[1], "-g") == 0);
+  int failures = 0;
+  unsigned int n = 0;
+
+  for (unsigned int t = 0; t < TypeCount; ++t) {
+    for (unsigned int b = 0; b < BevelCount; ++b) {
+      for (unsigned int i = 0; i < 2; ++i) {
+        for (unsigned int d = 0; d < DitherCount; ++d, ++n) {
+          const unsigned long texture_type =
+            bt::Texture::Gradient | types[t] | bevels[b]
+            | (i ? bt::Texture::Interlaced : 0ul);
+
+          bt::setThreadCount(1u);
+          const unsigned long hash = render(texture_type, dithers[d]);
+          bt::setThreadCount(4u);
+          const unsigned long threaded = render(texture_type, dithers[d]);
+
+          if (generate) {
+            printf("  0x%08lxul, // type %lx dither %u\n",
+                   hash, texture_type, d);
+            continue;
+          }
+
+          if (hash != threaded) {
+            fprintf(stderr, "texture %lx dither %u: threads changed the "
+                    "image (%08lx instead of %08lx)\n",
+                    texture_type, d, threaded, hash);
+            ++failures;
+          }
+          if (n >= sizeof(golden) / sizeof(golden[0])
+              || hash != golden[n]) {
+            fprintf(stderr, "texture %lx dither %u: checksum %08lx, "
+                    "expected %08lx\n", texture_type, d, hash,
+                    (n < sizeof(golden) / sizeof(golden[0]))
+                    ? golden[n] : 0ul);
+            ++failures;
+          }
+        }
+      }
+    }
+  }
+
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,162 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// render-test.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Checks that the gradients drawn with the RENDER extension match the
+ * ones rendered by bt::Image.  No X server is needed: the gradient that
+ * the server would draw is evaluated here from bt::gradientGeometry(),
+ * sampling each pixel at its center like the server does, and compared
+ * with bt::Image::render() into memory.
+ */
+
+#include "Color.hh"
+#include "Image.hh"
+#include "Texture.hh"
+
+#include <math.h>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <vector>
+
+
+// the largest difference allowed per channel
+static const int tolerance = 2;
+
+
+static int serverChannel(const bt::GradientGeometry &geometry,
+                         unsigned int x, unsigned int y,
+                         int from, int to) {
+  const double px = x + 0.5, py = (y + 0.5) * geometry.y_scale;
+  double t;
+  if (!geometry.radial) {
+    const double dx = geometry.x2 - geometry.x1;
+    const double dy = geometry.y2 - geometry.y1;
+    t = (((px - geometry.x1) * dx) + ((py - geometry.y1) * dy))
+        / ((dx * dx) + (dy * dy));
+  } else {
+    const double dx = px - geometry.x1, dy = py - geometry.y1;
+    t = 1.0 - (sqrt((dx * dx) + (dy * dy)) / geometry.radius);
+  }
+  t = std::min(std::max(t, 0.0), 1.0);
+  return static_cast<int>(from + ((to - from) * t) + 0.5);
+}
+
+
+static bool check(unsigned long type, const char *name,
+                  unsigned int width, unsigned int height,
+                  const bt::Color &from, const bt::Color &to) {
+  bt::Texture texture;
+  texture.setTexture(bt::Texture::Gradient | bt::Texture::Flat | type);
+  texture.setColor1(from);
+  texture.setColor2(to);
+
+  bt::GradientGeometry geometry;
+  if (!bt::gradientGeometry(texture.texture(), width, height, geometry)) {
+    fprintf(stderr, "%s %ux%u: no gradient geometry\n", name, width, height);
+    return false;
+  }
+
+  // the default format is 0x00rrggbb
+  const bt::ImageFormat format;
+  std::vector<unsigned int> pixels(width * height);
+  bt::Image image(width, height);
+  if (!image.render(texture, format,
+                    reinterpret_cast<unsigned char *>(&pixels[0]))) {
+    fprintf(stderr, "%s %ux%u: not rendered\n", name, width, height);
+    return false;
+  }
+
+  for (unsigned int y = 0; y < height; ++y) {
+    for (unsigned int x = 0; x < width; ++x) {
+      const unsigned int pixel = pixels[(y * width) + x];
+      const int client[3] = {
+        static_cast<int>((pixel >> 16) & 0xff),
+        static_cast<int>((pixel >> 8) & 0xff),
+        static_cast<int>(pixel & 0xff)
+      };
+      const int server[3] = {
+        serverChannel(geometry, x, y, from.red(), to.red()),
+        serverChannel(geometry, x, y, from.green(), to.green()),
+        serverChannel(geometry, x, y, from.blue(), to.blue())
+      };
+      for (unsigned int c = 0; c < 3; ++c) {
+        if (abs(client[c] - server[c]) > tolerance) {
+          fprintf(stderr,
+                  "%s %ux%u: pixel %u,%u channel %u is %d, server draws %d\n",
+                  name, width, height, x, y, c, client[c], server[c]);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
+int main(int, char **) {
+  bt::Image::setDitherMode(bt::NoDither);
+
+  static const struct {
+    unsigned long type;
+    const char *name;
+  } types[] = {
+    { bt::Texture::Horizontal,    "horizontal" },
+    { bt::Texture::Vertical,      "vertical" },
+    { bt::Texture::Diagonal,      "diagonal" },
+    { bt::Texture::CrossDiagonal, "crossdiagonal" },
+    { bt::Texture::Elliptic,      "elliptic" }
+  };
+  static const unsigned int sizes[][2] = {
+    { 1, 1 }, { 2, 3 }, { 7, 5 }, { 16, 16 }, { 40, 9 }, { 200, 20 },
+    { 13, 300 }
+  };
+  const bt::Color colors[][2] = {
+    { bt::Color(0, 128, 255), bt::Color(255, 64, 0) },
+    { bt::Color(255, 255, 255), bt::Color(0, 0, 0) },
+    { bt::Color(90, 90, 90), bt::Color(91, 92, 93) }
+  };
+
+  int failures = 0;
+  for (unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); ++t) {
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+      for (unsigned int c = 0; c < sizeof(colors) / sizeof(colors[0]); ++c) {
+        if (!check(types[t].type, types[t].name, sizes[s][0], sizes[s][1],
+                   colors[c][0], colors[c][1]))
+          ++failures;
+      }
+    }
+  }
+
+  // RENDER cannot interlace, so those are left to bt::Image
+  bt::GradientGeometry geometry;
+  if (bt::gradientGeometry(bt::Texture::Gradient | bt::Texture::Horizontal
+                           | bt::Texture::Interlaced, 10, 10, geometry)) {
+    fprintf(stderr, "interlaced gradient drawn with RENDER\n");
+    ++failures;
+  }
+
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
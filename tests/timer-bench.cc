@@ -0,0 +1,150 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// timer-bench.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Measures bt::TimerQueue with thousands of active timers: restarting
+ * and stopping timers, as autoraise and the menu delay do, finding the
+ * deadline of the due timers, and firing them in order.
+ */
+
+#include "Timer.hh"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <vector>
+
+
+namespace {
+
+  class Manager : public bt::TimerQueueManager {
+  public:
+    void addTimer(bt::Timer *timer)
+    { queue.push(timer); }
+    void removeTimer(bt::Timer *timer)
+    { queue.release(timer); }
+
+    bt::TimerQueue queue;
+  };
+
+  class Handler : public bt::TimeoutHandler {
+  public:
+    void timeout(bt::Timer *)
+    { }
+  };
+
+  unsigned int seed = 1u;
+
+  unsigned int pick(unsigned int limit) {
+    seed = (seed * 1103515245u) + 12345u;
+    return (seed >> 16) % limit;
+  }
+
+} // namespace
+
+
+// pops all timers, which must come out in endpoint order
+static bool drain(bt::TimerQueue &queue) {
+  bt::Nanoseconds last = 0ll;
+  while (!queue.empty()) {
+    bt::Timer * const timer = queue.top();
+    if (timer->endpoint() < last)
+      return false;
+    last = timer->endpoint();
+    queue.pop();
+    timer->halt();
+  }
+  return true;
+}
+
+
+int main(int, char **) {
+  static const unsigned int counts[] = { 100u, 1000u, 5000u, 20000u };
+  static const unsigned int runs = 100000u;
+
+  Manager manager;
+  Handler handler;
+
+  printf("%-14s %12s %12s %12s %12s\n", "nanoseconds",
+         "restart", "stop+start", "deadline", "pop");
+  for (unsigned int c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+    const unsigned int count = counts[c];
+    std::vector<bt::Timer *> timers;
+    for (unsigned int i = 0; i < count; ++i) {
+      bt::Timer * const timer = new bt::Timer(&manager, &handler);
+      timer->setTimeout(1 + pick(10000u));
+      timer->setSlack(pick(4u) * 50);
+      timer->start();
+      timers.push_back(timer);
+    }
+    bt::Nanoseconds elapsed[4];
+
+    // restarting a queued timer moves it
+    bt::Nanoseconds start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      timers[pick(count)]->start();
+    elapsed[0] = bt::monotonicTime() - start;
+
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i) {
+      bt::Timer * const timer = timers[pick(count)];
+      timer->stop();
+      timer->setTimeout(1 + pick(10000u));
+      timer->start();
+    }
+    elapsed[1] = bt::monotonicTime() - start;
+
+    // keep the result alive so the search is not optimized away
+    bt::Nanoseconds sink = 0ll;
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      sink += manager.queue.deadline();
+    elapsed[2] = bt::monotonicTime() - start;
+    if (sink == 0ll)
+      return EXIT_FAILURE;
+
+    if (manager.queue.size() != count) {
+      fprintf(stderr, "%u timers: %lu queued\n", count,
+              static_cast<unsigned long>(manager.queue.size()));
+      return EXIT_FAILURE;
+    }
+    start = bt::monotonicTime();
+    const bool ordered = drain(manager.queue);
+    elapsed[3] = bt::monotonicTime() - start;
+    if (!ordered) {
+      fprintf(stderr, "%u timers: popped out of order\n", count);
+      return EXIT_FAILURE;
+    }
+
+    printf("%-14u %12.1f %12.1f %12.1f %12.1f\n", count,
+           static_cast<double>(elapsed[0]) / runs,
+           static_cast<double>(elapsed[1]) / runs,
+           static_cast<double>(elapsed[2]) / runs,
+           static_cast<double>(elapsed[3]) / count);
+
+    for (unsigned int i = 0; i < count; ++i)
+      delete timers[i];
+  }
+  return EXIT_SUCCESS;
+}
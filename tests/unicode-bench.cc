@@ -0,0 +1,152 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// unicode-bench.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Measures bt::toUtf32() and bt::toUtf8() on window titles, against
+ * the same conversions done through iconv, which is what they used
+ * before.
+ */
+
+#include "Timer.hh"
+#include "Unicode.hh"
+
+#include <iconv.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+
+// UTF-8 to UTF-32 through iconv, in native byte order
+static bt::ustring iconvToUtf32(iconv_t cd, const std::string &in) {
+  bt::ustring out(in.size() + 1, 0);
+  char *inp = const_cast<char *>(in.data());
+  size_t in_bytes = in.size();
+  char *outp = reinterpret_cast<char *>(&out[0]);
+  size_t out_bytes = out.size() * sizeof(bt::Uchar);
+  iconv(cd, 0, 0, 0, 0);
+  iconv(cd, &inp, &in_bytes, &outp, &out_bytes);
+  out.resize(out.size() - out_bytes / sizeof(bt::Uchar));
+  return out;
+}
+
+
+static std::string iconvToUtf8(iconv_t cd, const bt::ustring &in) {
+  std::string out(in.size() * 4, '\0');
+  char *inp = reinterpret_cast<char *>(const_cast<bt::Uchar *>(in.data()));
+  size_t in_bytes = in.size() * sizeof(bt::Uchar);
+  char *outp = &out[0];
+  size_t out_bytes = out.size();
+  iconv(cd, 0, 0, 0, 0);
+  iconv(cd, &inp, &in_bytes, &outp, &out_bytes);
+  out.resize(out.size() - out_bytes);
+  return out;
+}
+
+
+int main(int, char **) {
+  if (!bt::hasUnicode()) {
+    fprintf(stderr, "no Unicode support\n");
+    return EXIT_FAILURE;
+  }
+
+  iconv_t to_utf32 = iconv_open("UTF-32LE", "UTF-8");
+  iconv_t to_utf8 = iconv_open("UTF-8", "UTF-32LE");
+  const unsigned int one = 1u;
+  if (*reinterpret_cast<const unsigned char *>(&one) != 1u) {
+    iconv_close(to_utf32);
+    iconv_close(to_utf8);
+    to_utf32 = iconv_open("UTF-32BE", "UTF-8");
+    to_utf8 = iconv_open("UTF-8", "UTF-32BE");
+  }
+  if (to_utf32 == reinterpret_cast<iconv_t>(-1)
+      || to_utf8 == reinterpret_cast<iconv_t>(-1)) {
+    perror("iconv_open");
+    return EXIT_FAILURE;
+  }
+
+  static const struct {
+    const char *name;
+    const char *utf8;
+  } titles[] = {
+    { "ascii", "xterm - user@host: ~/src/blackbox/lib" },
+    { "latin", "R\xc3\xa9sum\xc3\xa9 - \xc3\x9c" "bersicht "
+               "\xc3\xa4nderungen" },
+    { "cjk", "\xe6\x96\x87\xe5\xad\x97\xe5\x8c\x96\xe3\x81\x91"
+             "\xe3\x81\xae\xe3\x83\x86\xe3\x82\xb9\xe3\x83\x88 - "
+             "\xe3\x82\xa8\xe3\x83\x87\xe3\x82\xa3\xe3\x82\xbf" },
+    { "emoji", "\xf0\x9f\x93\x81 files \xf0\x9f\x93\x9d notes "
+               "\xf0\x9f\x8e\xb5 music" }
+  };
+  static const unsigned int runs = 200000u;
+
+  printf("%-14s %10s %10s %10s %10s\n", "nanoseconds",
+         "toUtf32", "iconv", "toUtf8", "iconv");
+  for (unsigned int t = 0; t < sizeof(titles) / sizeof(titles[0]); ++t) {
+    const std::string utf8 = titles[t].utf8;
+    const bt::ustring utf32 = bt::toUtf32(utf8);
+    if (utf32 != iconvToUtf32(to_utf32, utf8)
+        || bt::toUtf8(utf32) != utf8
+        || iconvToUtf8(to_utf8, utf32) != utf8) {
+      fprintf(stderr, "%s: conversions disagree\n", titles[t].name);
+      return EXIT_FAILURE;
+    }
+
+    // keep the results alive so the conversions are not optimized away
+    unsigned long sink = 0;
+    bt::Nanoseconds elapsed[4];
+
+    bt::Nanoseconds start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      sink += bt::toUtf32(utf8).size();
+    elapsed[0] = bt::monotonicTime() - start;
+
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      sink += iconvToUtf32(to_utf32, utf8).size();
+    elapsed[1] = bt::monotonicTime() - start;
+
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      sink += bt::toUtf8(utf32).size();
+    elapsed[2] = bt::monotonicTime() - start;
+
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      sink += iconvToUtf8(to_utf8, utf32).size();
+    elapsed[3] = bt::monotonicTime() - start;
+
+    if (sink == 0ul)
+      return EXIT_FAILURE;
+
+    printf("%-14s", titles[t].name);
+    for (unsigned int i = 0; i < 4; ++i)
+      printf(" %10.1f", static_cast<double>(elapsed[i]) / runs);
+    printf("\n");
+  }
+
+  iconv_close(to_utf32);
+  iconv_close(to_utf8);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// unicode-test.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Checks the UTF-8 <-> UTF-32 conversions, including the handling of
+ * malformed, overlong and out of range input, which is dropped.
+ */
+
+#include "Unicode.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+
+static int failures = 0;
+
+
+static std::string hex(const std::string &string) {
+  std::string ret;
+  for (std::string::size_type i = 0; i < string.size(); ++i) {
+    char buf[4];
+    sprintf(buf, "%02x", static_cast<unsigned char>(string[i]));
+    if (i > 0)
+      ret += ' ';
+    ret += buf;
+  }
+  return ret;
+}
+
+
+static std::string hex(const bt::ustring &string) {
+  std::string ret;
+  for (bt::ustring::size_type i = 0; i < string.size(); ++i) {
+    char buf[12];
+    sprintf(buf, "%x", string[i]);
+    if (i > 0)
+      ret += ' ';
+    ret += buf;
+  }
+  return ret;
+}
+
+
+// bt::ustring from a zero terminated array
+static bt::ustring ustr(const bt::Uchar *chars) {
+  bt::ustring ret;
+  while (*chars)
+    ret += *chars++;
+  return ret;
+}
+
+
+static void checkDecode(const char *name, const std::string &utf8,
+                        const bt::ustring &expected) {
+  const bt::ustring utf32 = bt::toUtf32(utf8);
+  if (utf32 != expected) {
+    fprintf(stderr, "%s: %s decodes to '%s', expected '%s'\n", name,
+            hex(utf8).c_str(), hex(utf32).c_str(), hex(expected).c_str());
+    ++failures;
+  }
+}
+
+
+static void checkEncode(const char *name, const bt::ustring &utf32,
+                        const std::string &expected) {
+  const std::string utf8 = bt::toUtf8(utf32);
+  if (utf8 != expected) {
+    fprintf(stderr, "%s: %s encodes to '%s', expected '%s'\n", name,
+            hex(utf32).c_str(), hex(utf8).c_str(), hex(expected).c_str());
+    ++failures;
+  }
+
+  const bt::Utf8String stored(utf32);
+  if (stored.utf8() != expected
+      || stored.length() != bt::toUtf32(expected).length()) {
+    fprintf(stderr, "%s: Utf8String holds '%s' with length %lu\n", name,
+            hex(stored.utf8()).c_str(),
+            static_cast<unsigned long>(stored.length()));
+    ++failures;
+  }
+}
+
+
+int main(int, char **) {
+  if (!bt::hasUnicode()) {
+    fprintf(stderr, "no Unicode support, skipped\n");
+    return 77; // skipped
+  }
+
+  // the boundaries of each sequence length
+  static const struct {
+    bt::Uchar u;
+    const char *utf8;
+  } valid[] = {
+    { 0x1u,      "\x01" },
+    { 0x7fu,     "\x7f" },
+    { 0x80u,     "\xc2\x80" },
+    { 0x7ffu,    "\xdf\xbf" },
+    { 0x800u,    "\xe0\xa0\x80" },
+    { 0xd7ffu,   "\xed\x9f\xbf" },
+    { 0xe000u,   "\xee\x80\x80" },
+    { 0xfffdu,   "\xef\xbf\xbd" },
+    { 0xffffu,   "\xef\xbf\xbf" },
+    { 0x10000u,  "\xf0\x90\x80\x80" },
+    { 0x10ffffu, "\xf4\x8f\xbf\xbf" }
+  };
+  for (unsigned int i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+    const bt::ustring u(1u, valid[i].u);
+    checkEncode("valid", u, valid[i].utf8);
+    checkDecode("valid", valid[i].utf8, u);
+  }
+
+  // malformed input is dropped, the rest is kept
+  static const struct {
+    const char *name;
+    const char *utf8;
+  } invalid[] = {
+    { "overlong 2 byte nul",    "\xc0\x80" },
+    { "overlong 2 byte",        "\xc1\xbf" },
+    { "overlong 3 byte",        "\xe0\x80\xaf" },
+    { "overlong 3 byte max",    "\xe0\x9f\xbf" },
+    { "overlong 4 byte",        "\xf0\x80\x80\xaf" },
+    { "overlong 4 byte max",    "\xf0\x8f\xbf\xbf" },
+    { "high surrogate",         "\xed\xa0\x80" },
+    { "low surrogate",          "\xed\xbf\xbf" },
+    { "beyond U+10FFFF",        "\xf4\x90\x80\x80" },
+    { "5 byte sequence",        "\xf8\x88\x80\x80\x80" },
+    { "6 byte sequence",        "\xfc\x84\x80\x80\x80\x80" },
+    { "lone continuation",      "\x80" },
+    { "continuation bytes",     "\x80\xbf\x80\xbf" },
+    { "invalid byte fe",        "\xfe" },
+    { "invalid byte ff",        "\xff" },
+    { "truncated 2 byte",       "\xc3" },
+    { "truncated 3 byte",       "\xe2\x82" },
+    { "truncated 4 byte",       "\xf0\x9f\x98" }
+  };
+  for (unsigned int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+    checkDecode(invalid[i].name, invalid[i].utf8, bt::ustring());
+    // surrounding text survives
+    const bt::Uchar ab[] = { 'a', 'b', 0 };
+    checkDecode(invalid[i].name,
+                std::string("a") + invalid[i].utf8 + "b", ustr(ab));
+  }
+
+  // a truncated sequence does not swallow the character after it
+  const bt::Uchar euro_a[] = { 'a', 0x20acu, 0 };
+  checkDecode("truncated then valid", "\xe2\x82" "a\xe2\x82\xac",
+              ustr(euro_a));
+
+  // characters that have no UTF-8 encoding are dropped
+  const bt::Uchar unencodable[] = {
+    'a', 0xd800u, 0xdfffu, 0x110000u, 0xffffffffu, 'b', 0
+  };
+  checkEncode("unencodable", ustr(unencodable), "ab");
+
+  // round trip of pseudo random bytes: whatever decodes must encode to
+  // UTF-8 that decodes to the same characters
+  unsigned int seed = 1u;
+  for (unsigned int n = 0; n < 20000; ++n) {
+    std::string bytes;
+    const unsigned int length = n % 16u;
+    for (unsigned int i = 0; i < length; ++i) {
+      seed = (seed * 1103515245u) + 12345u;
+      // favor the bytes that start and continue sequences
+      const unsigned int r = seed >> 16;
+      bytes += static_cast<char>((r & 1u) ? 0x80u + (r >> 1) % 0x80u
+                                          : (r >> 1) & 0xffu);
+    }
+    const bt::ustring utf32 = bt::toUtf32(bytes);
+    const std::string utf8 = bt::toUtf8(utf32);
+    if (bt::toUtf32(utf8) != utf32 || bt::toUtf8(bt::toUtf32(utf8)) != utf8) {
+      fprintf(stderr, "round trip of %s failed: %s -> %s\n",
+              hex(bytes).c_str(), hex(utf32).c_str(), hex(utf8).c_str());
+      ++failures;
+    }
+    for (bt::ustring::size_type i = 0; i < utf32.size(); ++i) {
+      const bt::Uchar u = utf32[i];
+      if (u > 0x10ffffu || (u >= 0xd800u && u <= 0xdfffu)) {
+        fprintf(stderr, "%s decodes to invalid character %x\n",
+                hex(bytes).c_str(), u);
+        ++failures;
+      }
+    }
+  }
+
+  // substrings of a Utf8String, by character
+  const bt::Uchar mixed[] = {
+    'a', 0xe9u, 0x20acu, 0x1f600u, 'b', 0x7ffu, 0x10ffffu, 0
+  };
+  const bt::ustring text = ustr(mixed);
+  const bt::Utf8String stored(text);
+  for (bt::ustring::size_type pos = 0; pos <= text.length(); ++pos) {
+    for (bt::ustring::size_type n = 0; n <= text.length() - pos; ++n) {
+      if (stored.unicode(pos, n) != text.substr(pos, n)) {
+        fprintf(stderr, "Utf8String::unicode(%lu, %lu) returned '%s'\n",
+                static_cast<unsigned long>(pos),
+                static_cast<unsigned long>(n),
+                hex(stored.unicode(pos, n)).c_str());
+        ++failures;
+      }
+    }
+  }
+
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// xidtable-bench.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Measures the event handler lookup done for every event dispatched by
+ * bt::Application, with bt::XIDTable and with the std::map it replaced,
+ * for up to 5000 windows.  Blackbox creates several windows for each
+ * client: the frame, title bar, label, buttons and handle.
+ */
+
+#include "Timer.hh"
+#include "XIDTable.hh"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <map>
+#include <vector>
+
+
+namespace {
+
+  unsigned int seed = 1u;
+
+  unsigned int pick(unsigned int limit) {
+    seed = (seed * 1103515245u) + 12345u;
+    return (seed >> 16) % limit;
+  }
+
+  // stands in for the bt::EventHandler of each window
+  struct Handler {
+    unsigned long events;
+  };
+
+} // namespace
+
+
+int main(int, char **) {
+  static const unsigned int counts[] = { 50u, 500u, 5000u };
+  static const unsigned int runs = 1000000u;
+
+  printf("%-14s %12s %12s %12s %12s\n", "nanoseconds",
+         "table hit", "map hit", "table miss", "map miss");
+  for (unsigned int c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+    const unsigned int count = counts[c];
+
+    /*
+      the windows of blackbox come from one block of resource ids, the
+      client windows from the blocks of other connections
+    */
+    std::vector<Handler> handlers(count);
+    std::vector<XID> windows, unknown;
+    for (unsigned int i = 0; i < count; ++i) {
+      windows.push_back((i % 6u == 0)
+                        ? ((2ul + i / 6u) << 21) + 0x0au
+                        : (1ul << 21) + 0x100u + i);
+      unknown.push_back((1ul << 21) + 0x100u + count + i);
+    }
+
+    bt::XIDTable<Handler *> table;
+    std::map<XID, Handler *> map;
+    for (unsigned int i = 0; i < count; ++i) {
+      table.insert(windows[i], &handlers[i]);
+      map.insert(std::make_pair(windows[i], &handlers[i]));
+    }
+
+    // the events arrive in random order
+    std::vector<unsigned int> order(runs);
+    for (unsigned int i = 0; i < runs; ++i)
+      order[i] = pick(count);
+
+    bt::Nanoseconds elapsed[4];
+    bt::Nanoseconds start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i) {
+      Handler ** const handler = table.find(windows[order[i]]);
+      if (handler)
+        ++(*handler)->events;
+    }
+    elapsed[0] = bt::monotonicTime() - start;
+
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i) {
+      const std::map<XID, Handler *>::iterator it =
+        map.find(windows[order[i]]);
+      if (it != map.end())
+        ++it->second->events;
+    }
+    elapsed[1] = bt::monotonicTime() - start;
+
+    // events for windows without a handler, like override redirect
+    // windows of other clients
+    unsigned long misses = 0ul;
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      misses += (table.find(unknown[order[i]]) == 0);
+    elapsed[2] = bt::monotonicTime() - start;
+
+    start = bt::monotonicTime();
+    for (unsigned int i = 0; i < runs; ++i)
+      misses += (map.find(unknown[order[i]]) == map.end());
+    elapsed[3] = bt::monotonicTime() - start;
+
+    unsigned long events = 0ul;
+    for (unsigned int i = 0; i < count; ++i)
+      events += handlers[i].events;
+    if (events != 2ul * runs || misses != 2ul * runs) {
+      fprintf(stderr, "%u windows: lookups disagree\n", count);
+      return EXIT_FAILURE;
+    }
+
+    printf("%-14u", count);
+    for (unsigned int i = 0; i < 4; ++i)
+      printf(" %12.1f", static_cast<double>(elapsed[i]) / runs);
+    printf("\n");
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+// -*- mode: C++; indent-tabs-mode: nil; c-basic-offset: 2; -*-
+// xidtable-test.cc for Blackbox - an X11 Window manager
+// Copyright (c) 2001 - 2005 Sean 'Shaleh' Perry <shaleh@debian.org>
+// Copyright (c) 1997 - 2000, 2002 - 2005
+//         Bradley T Hughes <bhughes at trolltech.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+
+/*
+ * Checks bt::XIDTable against std::map with random inserts and erases,
+ * and that None is never stored or found.
+ */
+
+#include "XIDTable.hh"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <map>
+
+
+static int failures = 0;
+
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "%s\n", what);
+    ++failures;
+  }
+}
+
+
+int main(int, char **) {
+  bt::XIDTable<int> table;
+
+  // None marks empty slots, so it can not be a key
+  check(table.find(None) == 0, "None found in an empty table");
+  check(!table.insert(None, 1), "None inserted into an empty table");
+  check(table.empty(), "inserting None changed the size");
+  check(table.insert(0x200001ul, 2), "insert failed");
+  check(table.find(None) == 0, "None found");
+  check(!table.insert(None, 3), "None inserted");
+  check(table.size() == 1u, "inserting None changed the size");
+  table.erase(None);
+  check(table.size() == 1u && table.find(0x200001ul) != 0
+        && *table.find(0x200001ul) == 2, "erasing None removed a value");
+  table.erase(0x200001ul);
+  check(table.empty() && table.find(0x200001ul) == 0, "erase failed");
+
+  /*
+    resource ids of a few clients, in blocks like the server hands them
+    out, so that the probe sequences collide and wrap around
+  */
+  std::map<XID, int> reference;
+  unsigned int seed = 1u;
+  for (int n = 0; n < 200000; ++n) {
+    seed = (seed * 1103515245u) + 12345u;
+    const unsigned int r = seed >> 8;
+    const XID key =
+      (static_cast<XID>(1u + (r % 4u)) << 21) + ((r >> 2) % 3000u);
+    switch ((r >> 16) % 3u) {
+    case 0: {
+      const bool inserted =
+        reference.insert(std::make_pair(key, n)).second;
+      check(table.insert(key, n) == inserted, "insert disagrees");
+      break;
+    }
+    case 1:
+      reference.erase(key);
+      table.erase(key);
+      break;
+    default: {
+      const std::map<XID, int>::const_iterator it = reference.find(key);
+      const int * const value = table.find(key);
+      check((it == reference.end()) ? value == 0
+            : value != 0 && *value == it->second, "find disagrees");
+      break;
+    }
+    }
+    check(table.size() == reference.size(), "size disagrees");
+    check(table.find(None) == 0, "None found");
+    if (failures > 10)
+      break;
+  }
+
+  return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}